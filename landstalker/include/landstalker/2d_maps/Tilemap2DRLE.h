@@ -5,6 +5,7 @@
 #include <cstdint>
 #include <cstdlib>
 #include <landstalker/tileset/Tile.h>
+#include <landstalker/misc/LZ77.h>
 
 namespace Landstalker {
 
@@ -33,7 +34,7 @@ public:
 	uint32_t Open(const std::vector<uint8_t>& data, Compression compression = Compression::RLE, size_t base = 0);
 	uint32_t Open(const std::vector<uint8_t>& data, size_t width, size_t height, Compression compression = Compression::NONE, size_t base = 0);
 
-	bool GetBits(std::vector<uint8_t>& data, Compression compression = Compression::NONE);
+	bool GetBits(std::vector<uint8_t>& data, Compression compression = Compression::NONE, LZ77::Level level = LZ77::Level::OPTIMAL);
 	bool Save(const std::string& filename, Compression compression = Compression::NONE);
 	Compression GetCompression() const;
 	void SetCompression(Compression c);
@@ -71,7 +72,7 @@ public:
 private:
 	std::vector<uint8_t> Compress() const;
 	uint32_t Uncompress(const std::vector<uint8_t>& data);
-	std::vector<uint8_t> CompressLZ77() const;
+	std::vector<uint8_t> CompressLZ77(LZ77::Level level) const;
 	uint32_t UncompressLZ77(const std::vector<uint8_t>& data);
 	uint32_t UnpackBytes(const std::vector<uint8_t>& data);
 	std::vector<uint8_t> PackBytes() const;
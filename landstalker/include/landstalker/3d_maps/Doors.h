@@ -6,8 +6,10 @@
 #include <cstdint>
 #include <string>
 #include <memory>
+#include <optional>
 #include <landstalker/misc/Literals.h>
 #include <landstalker/3d_maps/Tilemap3DCmp.h>
+#include <landstalker/3d_maps/Tilemap3DOverlay.h>
 
 namespace Landstalker {
 
@@ -49,6 +51,7 @@ struct Door
 	std::pair<int, int> GetTileOffset(std::shared_ptr<const Tilemap3D> tilemap = nullptr, const Tilemap3D::Layer& layer = Tilemap3D::Layer::BG) const;
 	std::pair<int, int> GetTileOffset(const Tilemap3D& tilemap, const Tilemap3D::Layer& layer = Tilemap3D::Layer::BG) const;
 	void DrawDoor(Tilemap3D& map, Tilemap3D::Layer layer) const;
+	void DrawDoor(Tilemap3DOverlay& overlay) const;
 
 	bool operator==(const Door& rhs) const;
 	bool operator!=(const Door& rhs) const;
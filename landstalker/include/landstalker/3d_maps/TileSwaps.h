@@ -6,6 +6,7 @@
 #include <map>
 #include <memory>
 #include <landstalker/3d_maps/Tilemap3DCmp.h>
+#include <landstalker/3d_maps/Tilemap3DOverlay.h>
 
 namespace Landstalker {
 
@@ -45,6 +46,7 @@ struct TileSwap
 	std::pair<int, int> GetTileOffset(TileSwap::Region region = TileSwap::Region::UNDEFINED, std::shared_ptr<const Tilemap3D> tilemap = nullptr, const Tilemap3D::Layer& layer = Tilemap3D::Layer::BG) const;
 	std::pair<int, int> GetRelTileOffset(const Tilemap3D::Layer& layer = Tilemap3D::Layer::BG) const;
 	void DrawSwap(Tilemap3D& map, Tilemap3D::Layer layer) const;
+	void DrawSwap(Tilemap3DOverlay& overlay) const;
 	void DrawHeightmapSwap(Tilemap3D& map) const;
 	bool IsHeightmapPointInSwap(int x, int y) const;
 
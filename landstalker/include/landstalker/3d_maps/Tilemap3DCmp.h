@@ -5,9 +5,13 @@
 #include <cstdlib>
 #include <vector>
 #include <string>
+#include <span>
 
 namespace Landstalker {
 
+class BitBarrel;
+class BitBarrelWriter;
+
 struct Point2D
 {
     int x;
@@ -85,6 +89,11 @@ public:
         ICE_NW = 45,
         HEALTH_RECOVER = 46
     };
+    enum class Compression
+    {
+        NORMAL,     // Single pass with a frequency-chosen offset dictionary
+        EXHAUSTIVE  // Searches offset dictionaries in parallel for the smallest output
+    };
 
     Tilemap3D()
     : foreground(),
@@ -100,11 +109,21 @@ public:
         Decode(src);
     }
 
+    Tilemap3D(std::span<const uint8_t> src)
+        : tile_width(8), tile_height(8)
+    {
+        Decode(src);
+    }
+
     bool operator==(const Tilemap3D& rhs) const;
     bool operator!=(const Tilemap3D& rhs) const;
 
     uint16_t Decode(const uint8_t* src);
-    uint16_t Encode(uint8_t* dst, size_t size);
+    // Decodes at most src.size() bytes, reusing this map's existing storage.
+    // Returns the number of bytes consumed; throws on truncated or corrupt data.
+    std::size_t Decode(std::span<const uint8_t> src);
+    // worker_count caps the threads used by an EXHAUSTIVE search; 0 uses every core.
+    uint16_t Encode(uint8_t* dst, size_t size, Compression mode = Compression::NORMAL, std::size_t worker_count = 0);
     bool FromCsv(const std::string& foreground_csv,
                  const std::string& background_csv,
                  const std::string& heightmap_csv);
@@ -159,6 +178,8 @@ public:
     bool IsBlockValid(const IsoPoint2D& iso) const;
     BlockLoc GetBlock(uint16_t block, Layer layer = Layer::FG) const;
     uint16_t GetBlock(const IsoPoint2D& iso, Layer layer = Layer::FG) const;
+    // Every block of one layer, row by row
+    const std::vector<uint16_t>& GetLayer(Layer layer) const;
     bool SetBlock(uint16_t block_value, uint16_t block_index, Layer layer = Layer::FG);
     bool SetBlock(const BlockLoc& loc, Layer layer = Layer::FG);
     uint8_t GetHeight(const HMPoint2D& iso) const;
@@ -170,6 +191,13 @@ public:
     uint16_t GetHeightmapCell(const HMPoint2D& iso) const;
     bool SetHeightmapCell(const HMPoint2D& iso, uint16_t value);
 private:
+    std::size_t Decode(BitBarrel& bb);
+    std::size_t DecodeMap(BitBarrel& bb);
+    void EncodeTiles(BitBarrelWriter& cmap, const std::vector<uint16_t>& tiles,
+                     const std::vector<uint16_t>& offsets, int min_run, bool verbose) const;
+    void SearchEncodingParameters(const std::vector<uint16_t>& tiles, const std::vector<uint16_t>& candidates,
+                                  std::vector<uint16_t>& offsets, int& min_run, std::size_t worker_count) const;
+
     std::vector<uint16_t> foreground;
     std::vector<uint16_t> background;
     std::vector<uint16_t> heightmap;
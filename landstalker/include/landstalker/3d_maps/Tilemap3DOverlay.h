@@ -0,0 +1,38 @@
+#ifndef _TILEMAP_3D_OVERLAY_H_
+#define _TILEMAP_3D_OVERLAY_H_
+
+#include <cstdint>
+#include <unordered_map>
+#include <landstalker/3d_maps/Tilemap3DCmp.h>
+
+namespace Landstalker {
+
+// A read-only view of one layer of a Tilemap3D with a sparse set of replaced
+// blocks on top. Tile swaps and doors draw into this instead of into a copy of
+// the map, so previewing them never touches or duplicates the source map.
+// The overlay holds a reference to the map, which must outlive it.
+class Tilemap3DOverlay
+{
+public:
+	Tilemap3DOverlay(const Tilemap3D& map, Tilemap3D::Layer layer);
+
+	const Tilemap3D& GetMap() const { return m_map; }
+	Tilemap3D::Layer GetLayer() const { return m_layer; }
+	uint8_t GetWidth() const { return m_map.GetWidth(); }
+	uint8_t GetHeight() const { return m_map.GetHeight(); }
+
+	// Same results as the equivalent Tilemap3D calls on a patched copy of the map
+	uint16_t GetBlock(const IsoPoint2D& iso) const;
+	bool SetBlock(const BlockLoc& loc);
+
+	bool IsModified() const { return !m_patches.empty(); }
+	void Clear() { m_patches.clear(); }
+private:
+	const Tilemap3D& m_map;
+	Tilemap3D::Layer m_layer;
+	std::unordered_map<uint16_t, uint16_t> m_patches;
+};
+
+} // namespace Landstalker
+
+#endif // _TILEMAP_3D_OVERLAY_H_
@@ -10,8 +10,14 @@ namespace Landstalker {
 class BlocksetCmp
 {
 public:
+    enum class Compression
+    {
+        NORMAL,     // Single greedy pass over the tile queue
+        OPTIMISED   // Searches alternative tile queue usage for the smallest output
+    };
+
     static uint16_t Decode(const uint8_t* src, size_t length, Blockset& blocks);
-    static uint16_t Encode(const Blockset& blocks, uint8_t* dst, size_t bufsize);
+    static uint16_t Encode(const Blockset& blocks, uint8_t* dst, size_t bufsize, Compression mode = Compression::NORMAL);
     static std::string ToCsv(const Blockset& blocks);
     static Blockset FromCsv(const std::string& csv_data);
 private:
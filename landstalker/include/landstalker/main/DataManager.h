@@ -7,6 +7,8 @@
 #include <vector>
 #include <landstalker/main/Rom.h>
 #include <landstalker/main/AsmFile.h>
+#include <landstalker/misc/Utils.h>
+#include <landstalker/misc/LZ77.h>
 #include <filesystem>
 #include <atomic>
 #include <mutex>
@@ -39,9 +41,18 @@ public:
 		virtual bool Save(const std::filesystem::path& dir);
 
 		DataManager* GetOwner() { return m_owner; }
+		// The owner's LZ77 level, for Serialise to compress with
+		LZ77::Level GetCompressionLevel() const { return m_owner ? m_owner->GetCompressionLevel() : LZ77::Level::OPTIMAL; }
 
+		// Data is edited in place through the mutable GetData(). Taking it is not
+		// a change by itself; editors call MarkDataChanged() once they have
+		// written through it.
 		std::shared_ptr<T> GetData();
 		std::shared_ptr<const T> GetData() const;
+		void MarkDataChanged() { ++m_revision; }
+		// Changes whenever the data is reloaded, committed, abandoned or marked
+		// as changed. Reads never move it.
+		uint32_t GetRevision() const { return m_revision; }
 		std::shared_ptr<const T> GetOrigData() const;
 		std::shared_ptr<const ByteVector> GetBytes();
 		std::shared_ptr<const ByteVector> GetOrigBytes() const;
@@ -65,6 +76,7 @@ public:
 		ByteVectorPtr m_raw_data;
 		ByteVectorPtr m_cached_raw_data;
 		DataManager* m_owner;
+		std::atomic<uint32_t> m_revision = 0;
 	};
 
 	DataManager(const std::string& content_description, const std::filesystem::path& asm_file) : m_ready(false), m_status("Waiting"), m_progress(0.0), m_asm_filename(asm_file),
@@ -102,6 +114,17 @@ public:
 
 	std::filesystem::path GetBasePath() const { return m_base_path; }
 	std::filesystem::path GetAsmFilename() const { return m_asm_filename; }
+
+	// Number of threads used to decode entries while loading. 0 uses every core.
+	void SetWorkerCount(std::size_t count) { m_worker_count = count; }
+	std::size_t GetWorkerCount() const { return m_worker_count; }
+
+	// LZ77 level entries are serialised with, both when measuring them and when
+	// saving them, so sizes and layout always agree. FAST keeps size checks quick
+	// while editing; OPTIMAL gives the smallest output for a final build.
+	// Managers that own other managers pass the level on to them.
+	virtual void SetCompressionLevel(LZ77::Level level) { m_compression_level = level; }
+	LZ77::Level GetCompressionLevel() const { return m_compression_level; }
 protected:
 	void SetProgress(const std::string& status, double progress) const
 	{
@@ -109,10 +132,24 @@ protected:
 		m_status = status;
 		m_progress = progress;
 	}
+	// As SetProgress, but ignored if it would move the same status backwards.
+	// Workers finish in any order, so later reports can carry smaller counts.
+	void AdvanceProgress(const std::string& status, double progress) const
+	{
+		std::lock_guard<std::mutex> guard(m_status_lock);
+		if (m_status != status || progress > m_progress)
+		{
+			m_status = status;
+			m_progress = progress;
+		}
+	}
 	mutable std::mutex m_busy_lock;
 	std::atomic<bool> m_ready;
 
 	virtual void CommitAllChanges();
+
+	template<class EntryPtr>
+	void InitialiseEntries(const std::vector<EntryPtr>& entries, const std::string& status) const;
 	
 	virtual bool GetFilenameFromAsm(AsmFile& file, const std::string& label, std::filesystem::path& path);
 
@@ -125,8 +162,26 @@ private:
 	std::filesystem::path m_asm_filename;
 	std::filesystem::path m_base_path;
 	std::string m_content_description;
+	std::atomic<std::size_t> m_worker_count = 0;
+	std::atomic<LZ77::Level> m_compression_level = LZ77::Level::OPTIMAL;
 };
 
+// Decodes a batch of independent entries across the worker threads. Each
+// entry only touches its own data, so the result is the same as decoding
+// them in order.
+template<class EntryPtr>
+inline void DataManager::InitialiseEntries(const std::vector<EntryPtr>& entries, const std::string& status) const
+{
+	std::atomic<std::size_t> done = 0;
+	SetProgress(status, 0.0);
+	ParallelFor(entries.size(), [&](std::size_t i)
+	{
+		entries[i]->Initialise();
+		const std::size_t count = done.fetch_add(1) + 1;
+		AdvanceProgress(status, static_cast<double>(count) / entries.size());
+	}, m_worker_count);
+}
+
 template<class T>
 inline DataManager::Entry<T>::Entry(DataManager* owner, const ByteVector& b, const std::string& name, const std::filesystem::path& filename)
 	: m_data(std::make_shared<T>()),
@@ -161,6 +216,7 @@ inline void DataManager::Entry<T>::Initialise()
 	Deserialise(m_raw_data, m_orig_data);
 	m_data = std::make_shared<T>(*m_orig_data);
 	m_saved_data = std::make_shared<T>(*m_orig_data);
+	MarkDataChanged();
 }
 
 template<class T>
@@ -171,6 +227,7 @@ inline void DataManager::Entry<T>::Commit()
 		Serialise(m_data, m_cached_raw_data);
 		*m_saved_data = *m_data;
 		*m_raw_data = *m_cached_raw_data;
+		MarkDataChanged();
 	}
 }
 
@@ -179,6 +236,7 @@ inline void DataManager::Entry<T>::AbandonChanges()
 {
 	*m_data = *m_saved_data;
 	m_cached_raw_data->clear();
+	MarkDataChanged();
 }
 
 template<class T>
@@ -202,7 +260,7 @@ inline std::shared_ptr<T> DataManager::Entry<T>::GetData()
 template<class T>
 inline std::shared_ptr<const T> DataManager::Entry<T>::GetData() const
 {
-	return GetData();
+	return m_data;
 }
 
 template<class T>
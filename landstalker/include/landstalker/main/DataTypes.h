@@ -1,6 +1,7 @@
 #ifndef _DATA_TYPES_H_
 #define _DATA_TYPES_H_
 
+#include <map>
 #include <landstalker/main/DataManager.h>
 #include <landstalker/tileset/Tileset.h>
 #include <landstalker/palettes/Palette.h>
@@ -126,6 +127,28 @@ private:
 	uint8_t sec;
 };
 
+// Primary and secondary blocksets concatenated, built once per pair and shared
+// until either entry changes: its revision moves, or its blocks no longer
+// match, which catches in-place edits that were never marked. Reading an
+// entry, even through the mutable GetData(), keeps the cached copy. Entries
+// are only weakly referenced, so the cache doesn't keep them alive.
+class CombinedBlocksetCache
+{
+public:
+	std::shared_ptr<const Blockset> Get(const std::shared_ptr<BlocksetEntry>& pri, const std::shared_ptr<BlocksetEntry>& sec) const;
+private:
+	struct Combined
+	{
+		std::weak_ptr<BlocksetEntry> pri;
+		std::weak_ptr<BlocksetEntry> sec;
+		uint32_t pri_revision;
+		uint32_t sec_revision;
+		std::shared_ptr<const Blockset> blockset;
+	};
+	mutable std::map<std::pair<const BlocksetEntry*, const BlocksetEntry*>, Combined> m_cache;
+	mutable std::mutex m_lock;
+};
+
 class Tilemap3DEntry : public DataManager::Entry<Tilemap3D>, public PalettePreferences
 {
 public:
@@ -36,6 +36,7 @@ public:
     virtual bool HasBeenModified() const;
     virtual bool InjectIntoRom(Rom& rom);
     virtual void RefreshPendingWrites(const Rom& rom);
+    virtual void SetCompressionLevel(LZ77::Level level);
 
     std::shared_ptr<RoomData> GetRoomData() const { return m_ready ? m_rd : nullptr; }
     std::shared_ptr<GraphicsData> GetGraphicsData() const { return m_ready ? m_gd : nullptr; }
@@ -4,6 +4,9 @@
 #include <vector>
 #include <memory>
 #include <optional>
+#include <span>
+#include <string>
+#include <functional>
 
 #include <landstalker/tileset/Tile.h>
 #include <landstalker/tileset/Tileset.h>
@@ -12,11 +15,33 @@
 #include <landstalker/sprites/SpriteFrame.h>
 #include <landstalker/2d_maps/Tilemap2DRLE.h>
 #include <landstalker/3d_maps/Tilemap3DCmp.h>
+#include <landstalker/3d_maps/Tilemap3DOverlay.h>
 #include <landstalker/3d_maps/TileSwaps.h>
 #include <landstalker/3d_maps/Doors.h>
 
 namespace Landstalker {
 
+struct PngOptions
+{
+	enum class Filter
+	{
+		DEFAULT, // Whatever libpng picks, which is no filtering for indexed images
+		NONE,
+		SUB,
+		UP,
+		AVERAGE,
+		PAETH,
+		ADAPTIVE // Tries every filter on each row and keeps the best
+	};
+
+	int compression_level = -1; // zlib level from 0 (store) to 9 (smallest), or -1 for zlib's default
+	Filter filter = Filter::DEFAULT;
+	bool use_alpha = true;
+	// Write only as many palette entries as the image needs, at the smallest
+	// bit depth that holds them, rather than a full 8-bit 256 colour palette
+	bool trim_palette = true;
+};
+
 class ImageBuffer
 {
 public:
@@ -26,6 +51,11 @@ public:
 		PRIORITY_ONLY,
 		NO_PRIORITY_ONLY
 	};
+	enum class PixelFormat
+	{
+		RGBA,
+		BGRA
+	};
 	ImageBuffer();
 	ImageBuffer(std::size_t width, std::size_t height);
 	virtual ~ImageBuffer() = default;
@@ -43,19 +73,47 @@ public:
 		const std::shared_ptr<const std::vector<MapBlock>> blockset, bool offset = true,
 		std::optional<std::vector<TileSwap>> swaps = std::nullopt, std::optional<std::vector<Door>> doors = std::nullopt, BlockMode mode = BlockMode::NORMAL);
 	bool WritePNG(const std::string& filename, const std::vector<std::shared_ptr<Palette>>& pals, bool use_alpha = true);
+	bool WritePNG(const std::string& filename, const std::vector<std::shared_ptr<Palette>>& pals, const PngOptions& options);
+	// Encodes the buffer as an indexed PNG in memory. The callback version hands
+	// over the encoded bytes in pieces as they are produced. Throws on failure.
+	std::vector<uint8_t> EncodePNG(const std::vector<std::shared_ptr<Palette>>& pals, const PngOptions& options = PngOptions()) const;
+	void EncodePNG(const std::function<void(std::span<const uint8_t>)>& write, const std::vector<std::shared_ptr<Palette>>& pals,
+		const PngOptions& options = PngOptions()) const;
 	void InsertBlock(std::size_t x, std::size_t y, uint8_t palette_index, const MapBlock& block, const Tileset& tileset, BlockMode mode = BlockMode::NORMAL);
 	const std::vector<uint8_t>& GetRGB(const std::vector<std::shared_ptr<Palette>>& pals) const;
 	const std::vector<uint8_t>& GetAlpha(const std::vector<std::shared_ptr<Palette>>& pals, uint8_t low_pri_max_opacity = 0xFF, uint8_t high_pri_max_opacity = 0xFF) const;
+	// Converts the whole buffer to 32-bit colour in one pass, straight into dest.
+	// Rows are stride bytes apart, or packed together if stride is 0. Alpha is
+	// capped by pixel priority in the same way as GetAlpha.
+	void ConvertToRGBA(std::span<uint8_t> dest, const std::vector<std::shared_ptr<Palette>>& pals, PixelFormat format = PixelFormat::RGBA,
+		uint8_t low_pri_max_opacity = 0xFF, uint8_t high_pri_max_opacity = 0xFF, std::size_t stride = 0) const;
 	std::size_t GetHeight() const;
 	std::size_t GetWidth() const;
+	// Number of threads InsertMap and Insert3DMapLayer split the buffer across,
+	// in horizontal bands. 0 uses every core. The output doesn't depend on it.
+	void SetWorkerCount(std::size_t count) { m_worker_count = count; }
+	std::size_t GetWorkerCount() const { return m_worker_count; }
 private:
+	// Half-open range of buffer rows that a draw call may write to
+	struct RowRange
+	{
+		std::size_t begin;
+		std::size_t end;
+	};
+	std::vector<RowRange> GetBands() const;
+	void DrawTile(int x, int y, uint8_t palette_index, const Tile& tile, const Tileset& tileset, bool use_alpha, BlockMode mode, const RowRange& rows);
+	void DrawBlock(std::size_t x, std::size_t y, uint8_t palette_index, const MapBlock& block, const Tileset& tileset, BlockMode mode, const RowRange& rows);
+	void DrawMap(int x, int y, uint8_t palette_index, const Tilemap2D& map, const Tileset& tileset, const RowRange& rows);
+	void Draw3DMapLayer(int x, int y, uint8_t palette_index, const Tilemap3DOverlay& disp_map, const Tileset& tileset,
+		const std::vector<MapBlock>& blockset, bool offset, BlockMode mode, const RowRange& rows);
+
 	std::size_t m_width;
 	std::size_t m_height;
 	std::vector<uint8_t> m_pixels;
 	std::vector<uint8_t> m_priority;
 	mutable std::vector<uint8_t> m_rgb;
-	mutable std::vector<uint8_t> m_rgba;
 	mutable std::vector<uint8_t> m_alpha;
+	std::size_t m_worker_count = 0;
 	//mutable wxImage m_img;
 };
 
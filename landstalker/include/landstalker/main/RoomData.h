@@ -29,8 +29,8 @@ public:
         LANTERN
     };
 
-    RoomData(const std::filesystem::path& asm_file);
-    RoomData(const Rom& rom);
+    RoomData(const std::filesystem::path& asm_file, std::size_t worker_count = 0);
+    RoomData(const Rom& rom, std::size_t worker_count = 0);
 
     virtual ~RoomData() {}
 
@@ -87,8 +87,11 @@ public:
     std::shared_ptr<TilesetEntry> GetTilesetForRoom(uint16_t roomnum) const;
     std::list<std::shared_ptr<BlocksetEntry>> GetBlocksetsForRoom(const std::string& name) const;
     std::list<std::shared_ptr<BlocksetEntry>> GetBlocksetsForRoom(uint16_t roomnum) const;
-    std::shared_ptr<Blockset> GetCombinedBlocksetForRoom(const std::string& name) const;
-    std::shared_ptr<Blockset> GetCombinedBlocksetForRoom(uint16_t roomnum) const;
+    // Primary and secondary blocksets concatenated. The result is shared between
+    // rooms using the same pair, so it is read-only; it is rebuilt once either
+    // blockset has been handed out for editing or marked changed.
+    std::shared_ptr<const Blockset> GetCombinedBlocksetForRoom(const std::string& name) const;
+    std::shared_ptr<const Blockset> GetCombinedBlocksetForRoom(uint16_t roomnum) const;
     std::shared_ptr<Tilemap3DEntry> GetMapForRoom(const std::string& name) const;
     std::shared_ptr<Tilemap3DEntry> GetMapForRoom(uint16_t roomnum) const;
     std::vector<uint8_t> GetChestsForRoom(uint16_t roomnum) const;
@@ -254,6 +257,7 @@ private:
     std::map<std::string, std::shared_ptr<BlocksetEntry>> m_blocksets_by_name_orig;
     std::map<std::pair<uint8_t, uint8_t>, std::shared_ptr<BlocksetEntry>> m_blocksets;
     std::map<std::pair<uint8_t, uint8_t>, std::shared_ptr<BlocksetEntry>> m_blocksets_orig;
+    CombinedBlocksetCache m_combined_blocksets;
 
     std::vector<std::shared_ptr<Room>> m_roomlist;
     std::vector<std::shared_ptr<Room>> m_roomlist_orig;
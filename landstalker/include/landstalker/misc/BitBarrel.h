@@ -9,30 +9,109 @@ namespace Landstalker {
 class BitBarrel
 {
 public:
+    // Unbounded reader: the caller guarantees every byte peeked at is readable,
+    // including bytes beyond the last bit that is eventually consumed.
     BitBarrel(const uint8_t* buf);
+    BitBarrel(const uint8_t* buf, size_t size);
     BitBarrel();
     bool empty();
     void newByte(uint8_t byte);
     operator bool();
     bool full();
     bool operator()(bool rhs);
-    
+
     template <class T>
     T read() const;
+    // Reads up to 32 bits, MSB first. Reading past the end of a bounded buffer
+    // yields zero bits and sets the overrun flag rather than throwing.
     uint32_t readBits(size_t numBits) const;
+    // Returns the next numBits bits without consuming them. An unbounded reader
+    // loads every byte holding those bits, even if fewer are then consumed.
+    uint32_t peekBits(size_t numBits) const;
+    void skipBits(size_t numBits) const;
     bool getNextBit() const;
     size_t getBytePosition() const;
+    // Always 0 for an unbounded reader, which has no known end
+    size_t getBitsRemaining() const;
+    bool overrun() const;
     void advanceNextByte();
-    
+
     uint8_t out();
 protected:
+    void refill(size_t numBits) const;
+    size_t getBitPosition() const;
+
     const uint8_t* const m_start;
+    const uint8_t* const m_end;
+    mutable const uint8_t* m_next;
+    mutable uint64_t m_acc;
+    mutable size_t m_count;
+    mutable size_t m_padding;
+
     mutable uint8_t m_val;
     mutable uint8_t m_pos;
-
-    mutable uint8_t* m_buf;
 };
 
+inline void BitBarrel::refill(size_t numBits) const
+{
+    if (m_end == nullptr)
+    {
+        // Unbounded: load only the bytes that hold the requested bits. A peek
+        // can still reach bytes past the last bit the caller goes on to consume.
+        while (m_count < numBits)
+        {
+            m_acc |= static_cast<uint64_t>(*m_next++) << (56 - m_count);
+            m_count += 8;
+        }
+        return;
+    }
+    while (m_count <= 56 && m_next != m_end)
+    {
+        m_acc |= static_cast<uint64_t>(*m_next++) << (56 - m_count);
+        m_count += 8;
+    }
+    if (m_count < numBits)
+    {
+        m_padding += numBits - m_count;
+        m_count = numBits;
+    }
+}
+
+inline uint32_t BitBarrel::peekBits(size_t numBits) const
+{
+    if (numBits == 0)
+    {
+        return 0;
+    }
+    if (m_count < numBits)
+    {
+        refill(numBits);
+    }
+    return static_cast<uint32_t>(m_acc >> (64 - numBits));
+}
+
+inline void BitBarrel::skipBits(size_t numBits) const
+{
+    if (m_count < numBits)
+    {
+        refill(numBits);
+    }
+    m_acc = (numBits < 64) ? (m_acc << numBits) : 0;
+    m_count -= numBits;
+}
+
+inline uint32_t BitBarrel::readBits(size_t numBits) const
+{
+    uint32_t retval = peekBits(numBits);
+    skipBits(numBits);
+    return retval;
+}
+
+inline bool BitBarrel::getNextBit() const
+{
+    return readBits(1) != 0;
+}
+
 } // namespace Landstalker
 
 #endif // BITBARREL_H
@@ -3,6 +3,7 @@
 
 #include <landstalker/misc/BitBarrel.h>
 #include <vector>
+#include <span>
 
 namespace Landstalker {
 
@@ -10,19 +11,36 @@ class BitBarrelWriter
 {
 public:
     BitBarrelWriter();
+    // Writes straight into the caller's buffer. Throws if the output grows
+    // larger than the buffer.
+    explicit BitBarrelWriter(std::span<uint8_t> out);
 
     template <class T>
     void Write(T value);
+    // Writes up to 32 bits, MSB first.
     void WriteBits(uint32_t value, size_t numBits);
     void AdvanceNextByte();
     void SetNextBit(bool value);
+    void Reserve(size_t bytes);
+    // Writes any bits still held in the accumulator out to the buffer.
+    void Flush() const;
     size_t GetByteCount() const;
-    std::vector<uint8_t>::const_iterator Begin() const;
-    std::vector<uint8_t>::const_iterator End() const;
+    std::span<const uint8_t> Data() const;
+    const uint8_t* Begin() const;
+    const uint8_t* End() const;
 
 private:
-    std::vector<uint8_t> m_buffer;
-    int m_bitpos;
+    void FlushWholeBytes();
+    void EnsureCapacity(size_t bytes) const;
+
+    mutable std::vector<uint8_t> m_buffer;
+    bool m_external;
+    mutable uint8_t* m_data;
+    mutable size_t m_capacity;
+    uint64_t m_acc;
+    size_t m_accbits;
+    size_t m_flushed;
+    size_t m_size;
 };
 
 
@@ -4,14 +4,42 @@
 #include <cstdlib>
 #include <cstdint>
 #include <vector>
+#include <span>
 
 namespace Landstalker {
 
 class LZ77
 {
 public:
+    // DISABLED_CompressionLevelBenchmark in tests/test_lz77.cpp reports the
+    // size and time of each level on flat-shaded tile data.
+    enum class Level
+    {
+        FAST,    // Greedy single pass: longest match at every position
+        LAZY,    // Greedy, but defers a match if the next byte has a longer one.
+                 // Usually smaller than FAST for a little more searching, but
+                 // deferring can misalign later matches, so it can lose to FAST
+        OPTIMAL  // Minimum-size parse; slowest, used for final ROM builds
+    };
+
     static std::size_t Decode(const uint8_t* inbuf, std::size_t bufsize, uint8_t* outbuf, std::size_t& elen);
-    static std::size_t Encode(const uint8_t* inbuf, std::size_t bufsize, uint8_t* outbuf);
+    // Decodes into a fixed-capacity output buffer. Throws std::runtime_error if the
+    // input ends before the end marker, if a back-reference points before the start
+    // of the output, or if the decoded data would not fit in the output buffer.
+    static std::size_t Decode(std::span<const uint8_t> in, std::span<uint8_t> out, std::size_t& elen);
+    // As Decode, but expands each decoded byte into 8 / bit_depth pixels, most
+    // significant first, written one per output byte. Back-references are
+    // resolved against the pixels already written, so no packed copy of the
+    // data is kept. Returns the number of pixels written.
+    static std::size_t DecodeAndUnpack(std::span<const uint8_t> in, std::span<uint8_t> out, std::size_t bit_depth, std::size_t& elen);
+    // As DecodeAndUnpack, but into a vector that is grown as needed, so the stream
+    // is only read once. The vector is resized to the number of pixels written.
+    static std::size_t DecodeAndUnpackToVector(std::span<const uint8_t> in, std::vector<uint8_t>& out, std::size_t bit_depth, std::size_t& elen);
+    // Walks the command bits and token headers of a stream without decoding it.
+    // Returns the decoded size, and sets elen to the number of compressed bytes
+    // up to and including the end marker. Throws std::runtime_error if truncated.
+    static std::size_t DecodedSize(std::span<const uint8_t> in, std::size_t& elen);
+    static std::size_t Encode(const uint8_t* inbuf, std::size_t bufsize, uint8_t* outbuf, Level level = Level::OPTIMAL);
 private:
     LZ77();
 
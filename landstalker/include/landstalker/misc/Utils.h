@@ -10,6 +10,12 @@
 #include <cstdint>
 #include <cwchar>
 #include <filesystem>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
+#include <system_error>
 
 namespace Landstalker {
 
@@ -189,6 +195,63 @@ std::string JoinStr(const std::vector<T>& elements, char delimiter = ',')
 	return ss.str();
 }
 
+// Calls fn(i) for every i in [0, count), spread across at most max_threads
+// threads (0 means one per core). Falls back to the calling thread alone if no
+// threads can be started. The first exception thrown by fn is rethrown once
+// all work has stopped.
+template<typename Fn>
+void ParallelFor(std::size_t count, Fn fn, std::size_t max_threads = 0)
+{
+	std::atomic<std::size_t> next = 0;
+	std::exception_ptr error;
+	std::mutex error_mutex;
+	auto worker = [&]()
+	{
+		for (std::size_t i = next++; i < count; i = next++)
+		{
+			try
+			{
+				fn(i);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error)
+				{
+					error = std::current_exception();
+				}
+				next = count;
+			}
+		}
+	};
+	if (max_threads == 0)
+	{
+		max_threads = std::max(1U, std::thread::hardware_concurrency());
+	}
+	const std::size_t num_threads = std::min(count, max_threads);
+	std::vector<std::thread> threads;
+	try
+	{
+		for (std::size_t t = 1; t < num_threads; ++t)
+		{
+			threads.emplace_back(worker);
+		}
+	}
+	catch (const std::system_error&)
+	{
+		// Carry on with however many threads we did get
+	}
+	worker();
+	for (auto& t : threads)
+	{
+		t.join();
+	}
+	if (error)
+	{
+		std::rethrow_exception(error);
+	}
+}
+
 } // namespace Landstalker
 
 #endif // UTILS_H
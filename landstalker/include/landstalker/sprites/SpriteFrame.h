@@ -6,6 +6,7 @@
 #include <optional>
 #include <landstalker/tileset/Tileset.h>
 #include <landstalker/misc/Point.h>
+#include <landstalker/misc/LZ77.h>
 
 namespace Landstalker {
 
@@ -54,7 +55,7 @@ public:
 
 	bool Open(const std::string& filename);
 	std::vector<uint8_t> GetBits();
-	std::vector<uint8_t> GetBits(bool compressed);
+	std::vector<uint8_t> GetBits(bool compressed, LZ77::Level level = LZ77::Level::OPTIMAL);
 	std::size_t SetBits(const std::vector<uint8_t>& src);
 	bool Save(const std::string& filename);
 	bool Save(const std::string& filename, bool compressed);
@@ -71,7 +72,8 @@ public:
 
 	std::vector<uint8_t>  GetTile(const Tile& tile) const;
 	std::pair<int, int>   GetTilePosition(const Tile& tile) const;
-	std::vector<uint8_t>& GetTilePixels(int tile_index);
+	// Drops the tileset's caches, as Tileset::GetTilePixels does
+	TilePixels GetTilePixels(int tile_index);
 	std::shared_ptr<const Tileset> GetTileset() const;
 	std::shared_ptr<Tileset> GetTileset();
 
@@ -2,6 +2,7 @@
 #define _HUFFMAN_TREE_
 
 #include <unordered_map>
+#include <array>
 #include <cstdint>
 #include <cstdlib>
 #include <memory>
@@ -46,12 +47,32 @@ private:
 		Node* parent;
 	};
 
+	// Result of walking the tree from the root with the next LOOKUP_BITS bits.
+	// node is the node reached (a leaf, or an internal node if the code is
+	// longer), or nullptr if the walk fell off a corrupt tree.
+	struct LookupEntry
+	{
+		const Node* node;
+		uint8_t bits;
+	};
+	static const size_t LOOKUP_BITS = 8;
+
+	// Codes of up to 64 bits are kept packed so they can be written in one go
+	struct Code
+	{
+		std::string str;
+		uint64_t bits;
+		size_t length;
+	};
+
 	void EncodeTreePreorder(BitBarrelWriter& bb, std::vector<uint8_t>& chrs, const Node* node);
 	void UpdateEncodingTable();
 	void UpdateEncodingTable(Node* node, std::string encoding);
+	void UpdateLookupTable();
 
 	Node* m_root;
-	std::unordered_map<uint8_t, std::string> m_encoding;
+	std::unordered_map<uint8_t, Code> m_encoding;
+	std::array<LookupEntry, 1 << LOOKUP_BITS> m_lookup;
 };
 
 } // namespace Landstalker
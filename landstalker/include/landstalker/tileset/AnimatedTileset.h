@@ -17,7 +17,16 @@ public:
     bool operator!=(const AnimatedTileset& rhs) const;
 
     std::vector<uint8_t> GetTile(const Tile& tile, uint8_t frame) const;
-    std::vector<uint8_t>& GetTilePixels(int tile_index, uint8_t frame);
+    // Drops the tileset's caches, as Tileset::GetTilePixels does
+    TilePixels GetTilePixels(int tile_index, uint8_t frame);
+    std::span<const uint8_t> GetTilePixels(int tile_index, uint8_t frame) const;
+    // View of a room tile's pixels in the given frame, keeping the tile's flips
+    TileView GetTileView(const Tile& tile, uint8_t frame) const;
+    // True if the room tile is one of the tiles this animation replaces
+    bool ContainsTile(const Tile& tile) const;
+    // True if the room tile looks different in this frame than in the one before
+    // it, i.e. whether it needs redrawing when the animation steps to this frame
+    bool HasTileChanged(const Tile& tile, uint8_t frame) const;
 
     uint16_t GetBaseBytes() const;
     Tile GetStartTile() const;
@@ -39,6 +48,8 @@ public:
     void SetBaseTileset(uint8_t base_tileset);
 
 private:
+    int GetFrameTileIndex(int tile_index, uint8_t frame) const;
+
     uint16_t m_base;
     uint16_t m_length;
     uint8_t m_speed;
@@ -5,13 +5,95 @@
 #include <cstdint>
 #include <vector>
 #include <array>
+#include <span>
+#include <optional>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <algorithm>
+#include <stdexcept>
 #include <landstalker/palettes/Palette.h>
 #include <landstalker/tileset/TileAttributes.h>
 #include <landstalker/tileset/Tile.h>
+#include <landstalker/misc/LZ77.h>
 
 namespace Landstalker
 {
 
+// Non-owning view of one tile's pixels as they appear once the tile's
+// flips are applied. Nothing is copied; flips are resolved on access.
+class TileView
+{
+public:
+    TileView(std::span<const uint8_t> pixels, std::size_t width, bool hflip, bool vflip)
+        : m_pixels(pixels), m_width(width), m_hflip(hflip), m_vflip(vflip)
+    {
+    }
+
+    std::size_t GetWidth() const { return m_width; }
+    std::size_t GetHeight() const { return m_pixels.size() / m_width; }
+    bool IsHFlipped() const { return m_hflip; }
+    bool IsVFlipped() const { return m_vflip; }
+
+    // The stored row shown at row y. Read it backwards if IsHFlipped().
+    std::span<const uint8_t> GetSourceRow(std::size_t y) const
+    {
+        return m_pixels.subspan((m_vflip ? GetHeight() - 1 - y : y) * m_width, m_width);
+    }
+    uint8_t operator()(std::size_t x, std::size_t y) const
+    {
+        return GetSourceRow(y)[m_hflip ? m_width - 1 - x : x];
+    }
+
+private:
+    std::span<const uint8_t> m_pixels;
+    std::size_t m_width;
+    bool m_hflip;
+    bool m_vflip;
+};
+
+// Mutable view of one tile's pixels, as handed out by Tileset::GetTilePixels.
+// It is a std::span, and keeps the parts of the std::vector interface that
+// the accessor returned before tiles were stored contiguously: checked at(),
+// assigning a whole tile and copying out to a vector. It can't be resized.
+// A copy views the same tile, so it can't be assigned from another view,
+// which would be ambiguous between rebinding and copying pixels; use Assign()
+// to copy pixels in, or Tileset::GetTileSpan for a plain span.
+class TilePixels : public std::span<uint8_t>
+{
+public:
+    TilePixels(std::span<uint8_t> pixels) : std::span<uint8_t>(pixels) {}
+    TilePixels(const TilePixels&) = default;
+    TilePixels& operator=(const TilePixels&) = delete;
+
+    uint8_t& at(std::size_t i) const
+    {
+        if (i >= size())
+        {
+            throw std::out_of_range("Tile pixel index out of range");
+        }
+        return (*this)[i];
+    }
+    // Copies pixels in, as assigning to the tile's vector did
+    void Assign(std::span<const uint8_t> pixels) const
+    {
+        if (pixels.size() != size())
+        {
+            throw std::runtime_error("Pixel count doesn't match the tile size");
+        }
+        std::copy(pixels.begin(), pixels.end(), begin());
+    }
+    TilePixels& operator=(std::span<const uint8_t> pixels)
+    {
+        Assign(pixels);
+        return *this;
+    }
+    operator std::vector<uint8_t>() const
+    {
+        return std::vector<uint8_t>(begin(), end());
+    }
+};
+
 class Tileset
 {
 public:
@@ -47,20 +129,33 @@ public:
     uint32_t SetBits(const std::vector<uint8_t>& src, bool compressed = false);
     void SetParams(std::size_t width = 8, std::size_t height = 8, uint8_t bit_depth = 4, BlockType blocktype = BlockType::NORMAL);
     bool Open(const std::string& filename, bool compressed = false, std::size_t width = 8, std::size_t height = 8, uint8_t bit_depth = 4, BlockType blocktype = BlockType::NORMAL);
-    std::vector<uint8_t> GetBits(bool compressed = false);
+    std::vector<uint8_t> GetBits(bool compressed = false, LZ77::Level level = LZ77::Level::OPTIMAL);
     bool Save(const std::string& filename, bool compressed = false);
     void Clear();
     void Reset(int size = -1);
     void Resize(int size);
     std::vector<uint8_t> GetTile(const Tile& tile) const;
-    std::vector<uint8_t>& GetTilePixels(int tile_index);
+    TileView GetTileView(const Tile& tile) const;
+    // Pixels of a single tile, one byte per pixel in row order. The span is
+    // invalidated by any call that changes the number of tiles. Taking a mutable
+    // span drops the search index and render cache, so writes made before the
+    // tileset is next searched or drawn are always seen.
+    TilePixels GetTilePixels(int tile_index);
+    std::span<const uint8_t> GetTilePixels(int tile_index) const;
+    // As GetTilePixels, as a plain span
+    std::span<uint8_t> GetTileSpan(int tile_index);
+    // Only needed when a mutable span is kept and written to after the tileset
+    // has since been searched or drawn
+    void MarkTilesDirty();
+    // Every tile back to back, GetTileWidth() * GetTileHeight() bytes apiece
+    std::span<const uint8_t> GetPixels() const;
     std::vector<uint8_t> GetTileRGB(const Tile& tile, const Palette& palette) const;
     std::vector<uint8_t> GetTileA(const Tile& tile, const Palette& palette) const;
     std::vector<uint32_t> GetTileRGBA(const Tile& tile, const Palette& palette) const;
     std::vector<uint32_t> GetTileBGRA(const Tile& tile, const Palette& palette) const;
     void SetColourIndicies(const std::string& colour_indicies);
     void SetColourIndicies(const std::vector<uint8_t>& colour_indicies);
-    std::vector<uint8_t> GetColourIndicies() const;
+    const std::vector<uint8_t>& GetColourIndicies() const;
     std::string GetColourIndiciesAsString() const;
     std::vector<uint8_t> GetDefaultColourIndicies() const;
     std::array<bool, 16> GetLockedColours() const;
@@ -80,9 +175,30 @@ public:
     void SwapTile(const Tile& lhs, const Tile& rhs);
     void SetTile(const Tile& src, const std::vector<uint8_t>& value);
 
+    // Finds an existing tile that shows the given pixels, either directly or
+    // once flipped. The returned Tile carries the flips needed. Unflipped
+    // matches are preferred, then H, V and HV; the lowest index wins a tie.
+    // Backed by a content hash index that the first search after an edit
+    // rebuilds. Like drawing, any number of threads may search the same
+    // tileset at once, as long as none of them edits it.
+    std::optional<Tile> FindTile(std::span<const uint8_t> pixels) const;
+    // Adds a run of tiles, each GetTileWidth() * GetTileHeight() pixels, reusing
+    // any tile already present in some flip. Returns the tile to use for each.
+    // The pixels must not refer to this tileset's own storage.
+    std::vector<Tile> ImportTiles(std::span<const uint8_t> pixels);
+
+    // A tile's rows as drawn, with its flips and colour remap already applied
+    // and eight pixels packed into each value in memory order. Empty unless
+    // tiles are 8 pixels wide; out-of-range tiles give tile 0 without logging,
+    // leaving the caller to report them. Comes from a cache rebuilt on first
+    // use after an edit. Any number of threads may draw from the same tileset
+    // at once, as long as none of them edits it.
+    std::span<const uint64_t> GetRenderedTile(const Tile& tile) const;
+    void PrepareRenderCache() const;
+
 private:
     void TransposeBlock();
-    void UntransposeBlock(std::vector<uint8_t>& bits);
+    void UntransposeBlock(std::vector<uint8_t>& bits) const;
 
     std::size_t m_width;
     std::size_t m_height;
@@ -92,7 +208,41 @@ private:
     bool m_compressed;
     
     BlockType m_blocktype;
-    std::vector<std::vector<uint8_t>> m_tiles;
+    std::size_t GetTileArea() const;
+    void CheckTileIndex(int tile_index) const;
+    void InvalidateCaches();
+    void PrepareTileIndex() const;
+    void RebuildTileIndex() const;
+    void RebuildRenderCache() const;
+
+    std::vector<uint8_t> m_pixels;
+    // Tile indices keyed by a hash of their pixels, see FindTile. Built and
+    // copied the same way as the render cache below.
+    struct TileIndex
+    {
+        TileIndex() = default;
+        TileIndex(const TileIndex&) {}
+        TileIndex& operator=(const TileIndex&) { valid = false; return *this; }
+
+        std::unordered_multimap<std::size_t, std::size_t> tiles;
+        std::atomic<bool> valid = false;
+        std::mutex lock;
+    };
+    mutable TileIndex m_tile_index;
+    // Every tile in all four flips, see GetRenderedTile. The first reader
+    // after an edit builds it under the lock; a copied tileset starts empty
+    // and builds its own.
+    struct RenderCache
+    {
+        RenderCache() = default;
+        RenderCache(const RenderCache&) {}
+        RenderCache& operator=(const RenderCache&) { valid = false; return *this; }
+
+        std::vector<uint64_t> tiles;
+        std::atomic<bool> valid = false;
+        std::mutex lock;
+    };
+    mutable RenderCache m_render_cache;
     std::vector<uint8_t> m_colour_indicies;
 };
 
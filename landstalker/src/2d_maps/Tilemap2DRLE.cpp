@@ -177,7 +177,7 @@ uint32_t Tilemap2D::Open(const std::vector<uint8_t>& data, size_t width, size_t
 	return Open(data, compression, base);
 }
 
-bool Tilemap2D::GetBits(std::vector<uint8_t>& data, Compression compressed)
+bool Tilemap2D::GetBits(std::vector<uint8_t>& data, Compression compressed, LZ77::Level level)
 {
 	std::vector<uint8_t> tile_data;
 	data.clear();
@@ -189,7 +189,7 @@ bool Tilemap2D::GetBits(std::vector<uint8_t>& data, Compression compressed)
 			tile_data = PackBytes();
 			break;
 		case Compression::LZ77:
-			tile_data = CompressLZ77();
+			tile_data = CompressLZ77(level);
 			break;
 		case Compression::RLE:
 			tile_data = Compress();
@@ -652,7 +652,7 @@ uint32_t Tilemap2D::Uncompress(const std::vector<uint8_t>& data)
 	return std::distance(data.begin(), d);
 }
 
-std::vector<uint8_t> Tilemap2D::CompressLZ77() const
+std::vector<uint8_t> Tilemap2D::CompressLZ77(LZ77::Level level) const
 {
 	auto bytes = PackBytes();
 	bytes.insert(bytes.begin(), {0,0,0,0});
@@ -661,7 +661,7 @@ std::vector<uint8_t> Tilemap2D::CompressLZ77() const
 	bytes[2] = static_cast<uint8_t>(m_width);
 	bytes[3] = static_cast<uint8_t>(m_height);
 	std::vector<uint8_t> result(65536);
-	auto elen = LZ77::Encode(bytes.data(), bytes.size(), result.data());
+	auto elen = LZ77::Encode(bytes.data(), bytes.size(), result.data(), level);
 	result.resize(elen);
 	return result;
 }
@@ -669,9 +669,8 @@ std::vector<uint8_t> Tilemap2D::CompressLZ77() const
 uint32_t Tilemap2D::UncompressLZ77(const std::vector<uint8_t>& data)
 {
 	std::size_t elen = 0;
-	std::vector<uint8_t> result(65536);
-	auto dlen = LZ77::Decode(data.data(), data.size(), result.data(), elen);
-	result.resize(dlen);
+	std::vector<uint8_t> result(LZ77::DecodedSize(data, elen));
+	LZ77::Decode(data, result, elen);
 	if (result.size() < 4) throw std::runtime_error("Bad LZ77 compressed map!");
 	m_left = result[0];
 	m_top = result[1];
@@ -197,28 +197,50 @@ std::pair<int, int> Door::GetTileOffset(const Tilemap3D& tilemap, const Tilemap3
 	return offset;
 }
 
+// The wall tiles a door covers, as a swap from an empty source region. Only
+// doors on north-east and north-west facing walls are drawn.
+static std::optional<TileSwap> GetDoorSwap(const Door& door, const Tilemap3D& tilemap)
+{
+	Tilemap3D::FloorType type = static_cast<Tilemap3D::FloorType>(tilemap.GetCellType({ door.x, door.y }));
+	int z = tilemap.GetHeight({ door.x, door.y });
+
+	TileSwap ts;
+	ts.map.src_x = 255;
+	ts.map.src_y = 255;
+	ts.map.dst_x = static_cast<uint8_t>(12 + door.x - z - Door::SIZES.at(door.size).second + (type == Tilemap3D::FloorType::DOOR_NW ? 1 : 0));
+	ts.map.dst_y = static_cast<uint8_t>(12 + door.y - z - Door::SIZES.at(door.size).second + (type == Tilemap3D::FloorType::DOOR_NW ? 1 : 0));
+	ts.map.width = Door::SIZES.at(door.size).first;
+	ts.map.height = Door::SIZES.at(door.size).second;
+	if (type != Tilemap3D::FloorType::DOOR_NE && type != Tilemap3D::FloorType::DOOR_NW)
+	{
+		return std::nullopt;
+	}
+	ts.mode = (type == Tilemap3D::FloorType::DOOR_NE) ? TileSwap::Mode::WALL_NE : TileSwap::Mode::WALL_NW;
+	return ts;
+}
+
 void Door::DrawDoor(Tilemap3D& tilemap, Tilemap3D::Layer layer) const
 {
 	if (layer == Tilemap3D::Layer::BG)
 	{
 		return;
 	}
-	Tilemap3D::FloorType type = static_cast<Tilemap3D::FloorType>(tilemap.GetCellType({ x, y }));
-	int z = tilemap.GetHeight({ x, y });
+	if (auto ts = GetDoorSwap(*this, tilemap))
+	{
+		ts->DrawSwap(tilemap, layer);
+	}
+}
 
-	TileSwap ts;
-	ts.map.src_x = 255;
-	ts.map.src_y = 255;
-	ts.map.dst_x = static_cast<uint8_t>(12 + x - z - Door::SIZES.at(size).second + (type == Tilemap3D::FloorType::DOOR_NW ? 1 : 0));
-	ts.map.dst_y = static_cast<uint8_t>(12 + y - z - Door::SIZES.at(size).second + (type == Tilemap3D::FloorType::DOOR_NW ? 1 : 0));
-	ts.map.width = SIZES.at(size).first;
-	ts.map.height = SIZES.at(size).second;
-	if (type != Tilemap3D::FloorType::DOOR_NE && type != Tilemap3D::FloorType::DOOR_NW)
+void Door::DrawDoor(Tilemap3DOverlay& overlay) const
+{
+	if (overlay.GetLayer() == Tilemap3D::Layer::BG)
 	{
 		return;
 	}
-	ts.mode = (type == Tilemap3D::FloorType::DOOR_NE) ? TileSwap::Mode::WALL_NE : TileSwap::Mode::WALL_NW;
-	ts.DrawSwap(tilemap, layer);
+	if (auto ts = GetDoorSwap(*this, overlay.GetMap()))
+	{
+		ts->DrawSwap(overlay);
+	}
 }
 
 bool Door::operator==(const Door& rhs) const
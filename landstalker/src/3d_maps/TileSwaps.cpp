@@ -271,58 +271,76 @@ std::pair<int, int> TileSwap::GetRelTileOffset(const Tilemap3D::Layer& layer) co
 	}
 }
 
-void TileSwap::DrawSwap(Tilemap3D& tilemap, Tilemap3D::Layer layer) const
+// Shared by both DrawSwap overloads. Blocks are read back through get() as
+// they are written, so overlapping source and destination regions behave the
+// same whichever target is being drawn into.
+template <class GetFn, class SetFn>
+static void ApplySwap(const TileSwap& swap, const Tilemap3D& tilemap, Tilemap3D::Layer layer, GetFn get, SetFn set)
 {
 	for (int y = 0; y < tilemap.GetHeight(); ++y)
 	{
 		for (int x = 0; x < tilemap.GetWidth(); ++x)
 		{
 			uint16_t swapped = 0;
-			int x_off = x - map.dst_x + tilemap.GetLeft();
-			int y_off = y - map.dst_y + tilemap.GetTop();
+			int x_off = x - swap.map.dst_x + tilemap.GetLeft();
+			int y_off = y - swap.map.dst_y + tilemap.GetTop();
 			bool swap_condition = false;
-			switch (mode)
+			switch (swap.mode)
 			{
 			case TileSwap::Mode::FLOOR:
-				swap_condition = (x_off >= 0 && x_off < map.width) && (y_off >= 0 && y_off < map.height);
+				swap_condition = (x_off >= 0 && x_off < swap.map.width) && (y_off >= 0 && y_off < swap.map.height);
 				break;
 			case TileSwap::Mode::WALL_NE:
 				if (layer == Tilemap3D::Layer::BG)
 				{
-					swap_condition = (x_off - y_off >= 0 && x_off - y_off < map.width) &&
-						(y_off >= 0 && y_off < map.height);
+					swap_condition = (x_off - y_off >= 0 && x_off - y_off < swap.map.width) &&
+						(y_off >= 0 && y_off < swap.map.height);
 				}
 				else
 				{
-					swap_condition = (x_off - y_off - 1 >= 0 && x_off - y_off - 1 < map.width) &&
-						(y_off >= 0 && y_off < map.height);
+					swap_condition = (x_off - y_off - 1 >= 0 && x_off - y_off - 1 < swap.map.width) &&
+						(y_off >= 0 && y_off < swap.map.height);
 				}
 				break;
 			case TileSwap::Mode::WALL_NW:
 				if (layer == Tilemap3D::Layer::BG)
 				{
-					swap_condition = (x_off >= 0 && x_off < map.height) &&
-						(y_off > x_off && y_off <= x_off + map.width);
+					swap_condition = (x_off >= 0 && x_off < swap.map.height) &&
+						(y_off > x_off && y_off <= x_off + swap.map.width);
 				}
 				else
 				{
-					swap_condition = (x_off >= 0 && x_off < map.height) &&
-						(y_off >= x_off && y_off < x_off + map.width);
+					swap_condition = (x_off >= 0 && x_off < swap.map.height) &&
+						(y_off >= x_off && y_off < x_off + swap.map.width);
 				}
 				break;
 			}
-			int src_x = map.src_x - map.dst_x + x;
-			int src_y = map.src_y - map.dst_y + y;
+			int src_x = swap.map.src_x - swap.map.dst_x + x;
+			int src_y = swap.map.src_y - swap.map.dst_y + y;
 			if (swap_condition)
 			{
 				swapped = (src_x >= 0 && src_x < tilemap.GetWidth() && src_y >= 0 && src_y < tilemap.GetHeight()) ?
-					tilemap.GetBlock({ src_x, src_y }, layer) : 0;
-				tilemap.SetBlock({ swapped, {x, y} }, layer);
+					get({ src_x, src_y }) : 0;
+				set(BlockLoc{ swapped, {x, y} });
 			}
 		}
 	}
 }
 
+void TileSwap::DrawSwap(Tilemap3D& tilemap, Tilemap3D::Layer layer) const
+{
+	ApplySwap(*this, tilemap, layer,
+		[&](const IsoPoint2D& p) { return tilemap.GetBlock(p, layer); },
+		[&](const BlockLoc& loc) { tilemap.SetBlock(loc, layer); });
+}
+
+void TileSwap::DrawSwap(Tilemap3DOverlay& overlay) const
+{
+	ApplySwap(*this, overlay.GetMap(), overlay.GetLayer(),
+		[&](const IsoPoint2D& p) { return overlay.GetBlock(p); },
+		[&](const BlockLoc& loc) { overlay.SetBlock(loc); });
+}
+
 void TileSwap::DrawHeightmapSwap(Tilemap3D& tilemap) const
 {
 	for (int y = 0; y < heightmap.height; ++y)
@@ -7,6 +7,7 @@
 #include <functional>
 #include <cstdint>
 #include <algorithm>
+#include <bit>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -20,12 +21,17 @@ namespace Landstalker {
 
 static uint16_t getCodedNumber(BitBarrel& bb)
 {
-    uint16_t exp = 0, num = 0;
-    
-    while(!bb.getNextBit())
+    // Unary-coded exponent, followed by that many bits of mantissa. The peek may
+    // run up to two bytes past the number; in a well-formed map those always
+    // exist, as the heightmap dimensions follow the last one.
+    const uint16_t prefix = static_cast<uint16_t>(bb.peekBits(16));
+    if (prefix == 0)
     {
-        exp++;
+        throw std::runtime_error("Bad coded number in compressed map data");
     }
+    const uint16_t exp = static_cast<uint16_t>(std::countl_zero(prefix));
+    uint16_t num = 0;
+    bb.skipBits(exp + 1);
     
     if(exp)
     {
@@ -68,10 +74,34 @@ bool Tilemap3D::operator!=(const Tilemap3D& rhs) const
 uint16_t Tilemap3D::Decode(const uint8_t* src)
 {
     BitBarrel bb(src);
-    foreground.clear();
-    background.clear();
-    heightmap.clear();
+    return static_cast<uint16_t>(Decode(bb));
+}
+
+std::size_t Tilemap3D::Decode(std::span<const uint8_t> src)
+{
+    BitBarrel bb(src.data(), src.size());
+    return Decode(bb);
+}
 
+std::size_t Tilemap3D::Decode(BitBarrel& bb)
+{
+    try
+    {
+        return DecodeMap(bb);
+    }
+    catch (const std::exception&)
+    {
+        // Don't leave a half-decoded map behind
+        foreground.clear();
+        background.clear();
+        heightmap.clear();
+        width = height = hmwidth = hmheight = 0;
+        throw;
+    }
+}
+
+std::size_t Tilemap3D::DecodeMap(BitBarrel& bb)
+{
     left   = static_cast<uint8_t>(bb.readBits(8));
     top    = static_cast<uint8_t>(bb.readBits(8));
     width  = static_cast<uint8_t>(bb.readBits(8) + 1);
@@ -85,8 +115,16 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
                                      static_cast<uint16_t>(GetWidth() *2u),
                                      static_cast<uint16_t>(GetWidth() + 1),
                                      0, 0, 0, 0, 0, 0, 0, 0};
-    const uint16_t t = GetSize() * 2;
-    std::vector<uint16_t> buffer(t,0);
+    const int t = GetSize() * 2;
+    // The stream addresses both layers as one run of 2 * size cells, foreground
+    // first. Decode straight into the existing layer storage.
+    const int half = t / 2;
+    foreground.assign(half, 0);
+    background.assign(half, 0);
+    auto cell = [&](int addr) -> uint16_t&
+    {
+        return (addr < half) ? foreground[addr] : background[addr - half];
+    };
     
     tileDictionary[1] = static_cast<uint16_t>(bb.readBits(10));
     tileDictionary[0] = static_cast<uint16_t>(bb.readBits(10));
@@ -96,7 +134,7 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
         offsetDictionary[i] = static_cast<uint16_t>(bb.readBits(12));
     }
     
-    int16_t dst_addr = -1;
+    int dst_addr = -1;
     
     while(true)
     {
@@ -115,18 +153,22 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
         {
             command = static_cast<uint8_t>(6 + (((command & 1) << 2) | bb.readBits(2)));
         }
-        buffer[dst_addr] = offsetDictionary[command];
+        cell(dst_addr) = offsetDictionary[command];
         
         if(bb.getNextBit())
         {
-            uint16_t row_addr = dst_addr;
+            int row_addr = dst_addr;
             bool width_offset = bb.getNextBit();
             do
             {
                 do
                 {
                     row_addr += GetWidth() + (width_offset ? 1 : 0);
-                    buffer[row_addr] = offsetDictionary[command];
+                    if(row_addr >= t)
+                    {
+                        throw std::runtime_error("Vertical run out of range in compressed map data");
+                    }
+                    cell(row_addr) = offsetDictionary[command];
                 } while(bb.getNextBit());
                 width_offset = !width_offset;
             } while(bb.getNextBit());
@@ -135,17 +177,21 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
     
     uint16_t tiles[2] = {tileDictionary[0], tileDictionary[1]};
     dst_addr = 0;
-    do
+    while(dst_addr < t)
     {
-        uint16_t operand = buffer[dst_addr];
-        uint16_t offset;
+        uint16_t operand = cell(dst_addr);
+        int offset;
         if(operand != 0xFFFF)
         {
             offset = dst_addr - operand;
+            if(offset < 0)
+            {
+                throw std::runtime_error("Back reference before start of compressed map data");
+            }
             do
             {
-                buffer[dst_addr++] = buffer[offset++];
-            } while ((dst_addr < t) && (buffer[dst_addr] == 0));
+                cell(dst_addr++) = cell(offset++);
+            } while ((dst_addr < t) && (cell(dst_addr) == 0));
         }
         else
         {
@@ -160,7 +206,7 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
                         {
                             value = static_cast<uint16_t>(bb.readBits(ilog2(tiles[0])));
                         }
-                        buffer[dst_addr++] = value;
+                        cell(dst_addr++) = value;
                         break;
                     case 1:
                         if(tiles[1] != tileDictionary[1])
@@ -168,25 +214,20 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
                             value = static_cast<uint16_t>(bb.readBits(ilog2(tiles[1] - tileDictionary[1])));
                         }
                         value += tileDictionary[1];
-                        buffer[dst_addr++] = value;
+                        cell(dst_addr++) = value;
                         break;
                     case 2:
                         value = tiles[0]++;
-                        buffer[dst_addr++] = value;
+                        cell(dst_addr++) = value;
                         break;
                     case 3:
                         value = tiles[1]++;
-                        buffer[dst_addr++] = value;
+                        cell(dst_addr++) = value;
                         break;
                 }
-            } while ((dst_addr < t) && (buffer[dst_addr] == 0));
+            } while ((dst_addr < t) && (cell(dst_addr) == 0));
         }
-    } while(dst_addr < t);
-    
-    background.resize(GetSize());
-    foreground.resize(GetSize());
-    std::copy(buffer.begin() + t/2, buffer.end(), background.begin());
-    std::copy(buffer.begin(), buffer.begin() + t / 2, foreground.begin());
+    }
     
     bb.advanceNextByte();
     hmwidth = static_cast<uint8_t>(bb.readBits(8));
@@ -216,20 +257,20 @@ uint16_t Tilemap3D::Decode(const uint8_t* src)
         }
     }
     bb.advanceNextByte();
-    return static_cast<uint16_t>(bb.getBytePosition());
+    if(bb.overrun())
+    {
+        throw std::runtime_error("Unexpected end of input data");
+    }
+    return bb.getBytePosition();
 }
 
 void makeCodedNumber(uint16_t value, BitBarrelWriter& bb)
 {
     uint16_t exp = ilog2(value) - 1;
-    uint16_t i = exp;
     uint16_t num = value - (1 << exp);
 
-    while (i--)
-    {
-        bb.WriteBits(0, 1);
-    }
-    bb.WriteBits(1, 1);
+    // exp zeroes followed by a one
+    bb.WriteBits(1, exp + 1);
 
     if (exp)
     {
@@ -300,35 +341,9 @@ std::pair<int, int> findMatch(const std::vector<uint16_t>& input, size_t offset,
     return ret;
 }
 
-uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
+uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size, Compression mode, std::size_t worker_count)
 {
-    BitBarrelWriter cmap;
     std::vector<uint16_t> offsets = { 0, 1, 2, static_cast<uint16_t>(GetWidth()), static_cast<uint16_t>(GetWidth() * 2), static_cast<uint16_t>(GetWidth() + 1)};
-    struct LZ77Entry
-    {
-        LZ77Entry(int run_length_in, int back_offset_idx_in, int index_in)
-            : run_length(run_length_in), back_offset_idx(back_offset_idx_in), index(index_in)
-        {}
-        int run_length;
-        int back_offset_idx;
-        int index;
-        std::vector<std::pair<bool, int>> vertical_info;
-    };
-    struct TileEntry
-    {
-        TileEntry(uint8_t code_in, uint16_t data_in, uint8_t data_length_in)
-            : code(code_in), data(data_in), data_length(data_length_in)
-        {}
-        uint8_t code;
-        uint16_t data;
-        uint8_t data_length;
-    };
-    std::vector<LZ77Entry> lz77;
-    uint16_t tile_dict[2] = { 0 };
-    uint16_t tile_increment[2] = { 0 };
-    std::vector<TileEntry> tile_entries;
-    std::vector<std::pair<int, uint16_t>> hm_buffer;
-
     // COMPRESS MAP
     // Combine foreground and background
     std::vector<uint16_t> tiles(GetSize() * 2);
@@ -337,7 +352,6 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
     // First stage of map compression involves LZ77 with a fixed-size dictionary
     // STEP 1: Run map through LZ77 compressor. Make a list of LZ77 offset frequencies.
     std::unordered_map<int, int> offset_freq_count;
-    std::vector<bool> compressed(tiles.size(), false);
     size_t idx = 1;
     do
     {
@@ -385,6 +399,144 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
         std::cout << "Offset " << std::hex << offsets[i] << ": " << std::dec << offset_freq_count[offsets[i]] << std::endl;
     }
 #endif
+
+    int min_run = 1;
+    if (mode == Compression::EXHAUSTIVE)
+    {
+        // Candidate offsets: the most frequent seen during STEP 1, plus the
+        // short-range 2D neighbours and the other layer, which it can miss.
+        const size_t MAX_FREQUENT_CANDIDATES = 24;
+        std::vector<uint16_t> candidates;
+        for (const auto& fc : frequency_counts)
+        {
+            if (candidates.size() == MAX_FREQUENT_CANDIDATES)
+            {
+                break;
+            }
+            candidates.push_back(static_cast<uint16_t>(fc.first));
+        }
+        const int w = GetWidth();
+        for (int c : { 3, 4, w - 1, w + 2, w * 2 - 1, w * 2 + 1, w * 2 + 2, w * 3, w * 3 + 1, w * 4, static_cast<int>(GetSize()) })
+        {
+            candidates.push_back(static_cast<uint16_t>(c));
+        }
+        SearchEncodingParameters(tiles, candidates, offsets, min_run, worker_count);
+    }
+
+    BitBarrelWriter cmap({dst, size});
+    EncodeTiles(cmap, tiles, offsets, min_run, true);
+    cmap.Flush();
+    return static_cast<uint16_t>(cmap.GetByteCount());
+}
+
+void Tilemap3D::SearchEncodingParameters(const std::vector<uint16_t>& tiles, const std::vector<uint16_t>& candidates,
+                                         std::vector<uint16_t>& offsets, int& min_run, std::size_t worker_count) const
+{
+    const int MAX_PASSES = 4;
+    struct Trial
+    {
+        std::vector<uint16_t> offsets;
+        int min_run;
+        size_t size;
+    };
+    auto evaluate = [&](std::vector<Trial>& trials)
+    {
+        ParallelFor(trials.size(), [&](size_t i)
+        {
+            BitBarrelWriter trial;
+            EncodeTiles(trial, tiles, trials[i].offsets, trials[i].min_run, false);
+            trials[i].size = trial.GetByteCount();
+        }, worker_count);
+        // Lowest index wins ties, so the result doesn't depend on thread scheduling
+        return std::min_element(trials.begin(), trials.end(), [](const Trial& lhs, const Trial& rhs)
+        {
+            return lhs.size < rhs.size;
+        });
+    };
+
+    std::vector<uint16_t> pool;
+    for (uint16_t c : candidates)
+    {
+        if (c == 0 || c > 4095 || c >= tiles.size())
+        {
+            continue;
+        }
+        if (std::find(pool.begin(), pool.end(), c) == pool.end())
+        {
+            pool.push_back(c);
+        }
+    }
+
+    // First pick the minimum LZ77 run worth taking over literal tiles
+    std::vector<Trial> trials;
+    for (int run : { 1, 2, 3 })
+    {
+        trials.push_back({ offsets, run, 0 });
+    }
+    Trial best = *evaluate(trials);
+
+    // Then hill-climb: swap one dictionary slot at a time for a pool candidate,
+    // keeping the smallest result, until nothing improves.
+    for (int pass = 0; pass < MAX_PASSES; ++pass)
+    {
+        trials.clear();
+        for (size_t slot = 6; slot < best.offsets.size(); ++slot)
+        {
+            for (uint16_t c : pool)
+            {
+                if (std::find(best.offsets.begin(), best.offsets.end(), c) == best.offsets.end())
+                {
+                    Trial t = { best.offsets, best.min_run, 0 };
+                    t.offsets[slot] = c;
+                    trials.push_back(std::move(t));
+                }
+            }
+        }
+        if (trials.empty())
+        {
+            break;
+        }
+        auto it = evaluate(trials);
+        if (it->size >= best.size)
+        {
+            break;
+        }
+        best = *it;
+    }
+    offsets = best.offsets;
+    min_run = best.min_run;
+}
+
+void Tilemap3D::EncodeTiles(BitBarrelWriter& cmap, const std::vector<uint16_t>& tiles,
+                            const std::vector<uint16_t>& offsets, int min_run, bool verbose) const
+{
+    struct LZ77Entry
+    {
+        LZ77Entry(int run_length_in, int back_offset_idx_in, int index_in)
+            : run_length(run_length_in), back_offset_idx(back_offset_idx_in), index(index_in)
+        {}
+        int run_length;
+        int back_offset_idx;
+        int index;
+        std::vector<std::pair<bool, int>> vertical_info;
+    };
+    struct TileEntry
+    {
+        TileEntry(uint8_t code_in, uint16_t data_in, uint8_t data_length_in)
+            : code(code_in), data(data_in), data_length(data_length_in)
+        {}
+        uint8_t code;
+        uint16_t data;
+        uint8_t data_length;
+    };
+    std::vector<LZ77Entry> lz77;
+    uint16_t tile_dict[2] = { 0 };
+    uint16_t tile_increment[2] = { 0 };
+    std::vector<TileEntry> tile_entries;
+    std::vector<std::pair<int, uint16_t>> hm_buffer;
+    std::vector<bool> compressed(tiles.size(), false);
+    size_t idx = 1;
+
     // STEP 3: Compress map using LZ77 and the back offset dictionary created during step 2
 
     lz77.emplace_back(1, 0, 0);
@@ -392,6 +544,10 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
     do
     {
         auto result = findMatch(tiles, idx, offsets);
+        if (result.second < min_run)
+        {
+            result = { 0, 1 };
+        }
         if ((result.first != 0) || (lz77.back().back_offset_idx != 0))
         {
             lz77.emplace_back(result.second, result.first, static_cast<int>(idx));
@@ -403,7 +559,10 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
         if (lz77.back().back_offset_idx == 0)
         {
 #ifndef NDEBUG
-            std::cout << " LOAD TILE @ " << idx << std::endl;
+            if (verbose)
+            {
+                std::cout << " LOAD TILE @ " << idx << std::endl;
+            }
 #endif
             compressed[idx] = false;
             idx++;
@@ -411,9 +570,12 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
         else
         {
 #ifndef NDEBUG
-            std::cout << " LZ77 @ " << idx << " : copy " << lz77.back().run_length
-                      << " bytes from offset " << lz77.back().back_offset_idx << "("
-                      << (idx - offsets[lz77.back().back_offset_idx]) << ")" << std::endl;
+            if (verbose)
+            {
+                std::cout << " LZ77 @ " << idx << " : copy " << lz77.back().run_length
+                          << " bytes from offset " << lz77.back().back_offset_idx << "("
+                          << (idx - offsets[lz77.back().back_offset_idx]) << ")" << std::endl;
+            }
 #endif
             std::fill(compressed.begin() + idx, compressed.begin() + idx + lz77.back().run_length, true);
             idx += lz77.back().run_length;
@@ -421,6 +583,12 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
     } while (idx < tiles.size());
 
     // STEP 5: For each LZ77 operation, scan downwards and down-right in 2D, and combine entries
+    //         Entries are indexed by start position so that each row step is a single lookup.
+    std::vector<int> entry_at(tiles.size(), -1);
+    for (size_t i = 0; i < lz77.size(); ++i)
+    {
+        entry_at[lz77[i].index] = static_cast<int>(i);
+    }
     for (auto it = lz77.begin(); it != lz77.end(); ++it)
     {
         size_t count = 0;
@@ -433,10 +601,11 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
             while (next < tiles.size())
             {
                 next += GetWidth() + (right ? 1 : 0);
-                auto nit = std::find_if(it, lz77.end(), [&](const LZ77Entry& comp)
-                    {
-                        return (comp.index == static_cast<int>(next)) && (comp.back_offset_idx == it->back_offset_idx);
-                    });
+                auto nit = lz77.end();
+                if (next < tiles.size() && entry_at[next] != -1 && lz77[entry_at[next]].back_offset_idx == it->back_offset_idx)
+                {
+                    nit = lz77.begin() + entry_at[next];
+                }
                 if (nit != lz77.end())
                 {
                     count++;
@@ -505,6 +674,16 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
     for (const auto& irt : incrementing_tile_counts) unique_tiles.push_back(irt.first);
     if(unique_tiles.empty()) unique_tiles.push_back(0);
     
+    // Only the tiles not covered by LZ77 runs are costed
+    std::vector<uint16_t> literal_tiles;
+    for (size_t i = 0; i < tiles.size(); ++i)
+    {
+        if (!compressed[i])
+        {
+            literal_tiles.push_back(tiles[i]);
+        }
+    }
+
     int best_bits = 99999999;
     uint16_t best_td0 = unique_tiles.front();
     uint16_t best_td1 = min_dict_entry;
@@ -515,19 +694,19 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
             
             int bits = 0;
             uint16_t ti[2] = {0, 0};
-            for (size_t i = 0; i < tiles.size(); ++i) {
-                if (!compressed[i]) {
-                    bits += 2;
-                    if (tiles[i] == td0 + ti[0]) {
-                        ti[0]++;
-                    } else if (tiles[i] == td1 + ti[1]) {
-                        ti[1]++;
-                    } else if (tiles[i] >= td0 && tiles[i] < td0 + ti[0]) {
-                        bits += ilog2(ti[0]);
-                    } else {
-                        bits += ilog2(td1 + ti[1]);
-                    }
+            for (uint16_t tile : literal_tiles) {
+                bits += 2;
+                if (tile == td0 + ti[0]) {
+                    ti[0]++;
+                } else if (tile == td1 + ti[1]) {
+                    ti[1]++;
+                } else if (tile >= td0 && tile < td0 + ti[0]) {
+                    bits += ilog2(ti[0]);
+                } else {
+                    bits += ilog2(td1 + ti[1]);
                 }
+                // The cost only grows, so stop as soon as this pair can't win
+                if (bits >= best_bits) break;
             }
             if (bits < best_bits) {
                 best_bits = bits;
@@ -540,8 +719,11 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
     tile_dict[0] = best_td0;
     tile_dict[1] = best_td1;
 #ifndef NDEBUG
-    std::cout << "TILE DICT 1: " << std::hex << tile_dict[1] << std::endl;
-    std::cout << "TILE DICT 0: " << std::hex << tile_dict[0] << std::endl;
+    if (verbose)
+    {
+        std::cout << "TILE DICT 1: " << std::hex << tile_dict[1] << std::endl;
+        std::cout << "TILE DICT 0: " << std::hex << tile_dict[0] << std::endl;
+    }
 #endif
 
     // STEP 7: Start to compress tile data. Identify if tile is (1) equal to any in tile dictionary + increment,
@@ -555,7 +737,10 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
             {
                 tile_increment[0]++;
 #ifndef NDEBUG
-                std::cout << "INCREMENT TILE 1 [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                if (verbose)
+                {
+                    std::cout << "INCREMENT TILE 1 [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                }
 #endif
                 tile_entries.emplace_back(3_u8, 0_u16, 0_u8);
             }
@@ -563,21 +748,30 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
             {
                 tile_increment[1]++;
 #ifndef NDEBUG
-                std::cout << "INCREMENT TILE 2 [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                if (verbose)
+                {
+                    std::cout << "INCREMENT TILE 2 [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                }
 #endif
                 tile_entries.emplace_back(2_u8, 0_u16, 0_u8);
             }
             else if ((tiles[i] >= tile_dict[0]) && (tiles[i] < (tile_dict[0] + tile_increment[0])))
             {
 #ifndef NDEBUG
-                std::cout << "PLACE REL TILE [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                if (verbose)
+                {
+                    std::cout << "PLACE REL TILE [" << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                }
 #endif
                 tile_entries.emplace_back(1_u8, static_cast<uint16_t>(tiles[i] - tile_dict[0]), static_cast<uint8_t>(ilog2(tile_increment[0])));
             }
             else
             {
 #ifndef NDEBUG
-                std::cout << "PLACE TILE " << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                if (verbose)
+                {
+                    std::cout << "PLACE TILE " << std::hex << tiles[i] << " @ " << std::dec << i << std::endl;
+                }
 #endif
                 tile_entries.emplace_back(0_u8, tiles[i], static_cast<uint8_t>(ilog2(tile_dict[1] + tile_increment[1])));
             }
@@ -701,15 +895,6 @@ uint16_t Tilemap3D::Encode(uint8_t* dst, size_t size)
         }
         cmap.Write<uint8_t>(static_cast<uint8_t>(len));
     }
-    if (cmap.GetByteCount() <= size)
-    {
-        std::copy(cmap.Begin(), cmap.End(), dst);
-    }
-    else
-    {
-        throw std::runtime_error("Output buffer not large enough to hold result.");
-    }
-    return static_cast<uint16_t>(cmap.GetByteCount());
 }
 
 bool Tilemap3D::FromCsv(const std::string& foreground_csv, const std::string& background_csv, const std::string& heightmap_csv)
@@ -1369,6 +1554,11 @@ bool Tilemap3D::IsBlockValid(const IsoPoint2D& iso) const
     return IsIsoPointValid(iso);
 }
 
+const std::vector<uint16_t>& Tilemap3D::GetLayer(Layer layer) const
+{
+    return (layer == Layer::FG) ? foreground : background;
+}
+
 BlockLoc Tilemap3D::GetBlock(uint16_t block, Layer layer) const
 {
     BlockLoc ret{0xFFFF,{-1,-1}};
@@ -0,0 +1,39 @@
+#include <landstalker/3d_maps/Tilemap3DOverlay.h>
+
+namespace Landstalker {
+
+Tilemap3DOverlay::Tilemap3DOverlay(const Tilemap3D& map, Tilemap3D::Layer layer)
+	: m_map(map),
+	  m_layer(layer)
+{
+}
+
+uint16_t Tilemap3DOverlay::GetBlock(const IsoPoint2D& iso) const
+{
+	if (!m_patches.empty())
+	{
+		const uint16_t block = static_cast<uint16_t>(iso.x + iso.y * GetWidth());
+		if (m_map.IsBlockValid(block))
+		{
+			auto it = m_patches.find(block);
+			if (it != m_patches.cend())
+			{
+				return it->second;
+			}
+		}
+	}
+	return m_map.GetBlock(iso, m_layer);
+}
+
+bool Tilemap3DOverlay::SetBlock(const BlockLoc& loc)
+{
+	if (m_map.IsBlockValid(loc.position))
+	{
+		const uint16_t block = static_cast<uint16_t>(loc.position.x + loc.position.y * GetWidth());
+		m_patches[block] = loc.value & 0x3FF;
+		return true;
+	}
+	return false;
+}
+
+} // namespace Landstalker
@@ -5,13 +5,15 @@
 #include <cstring>
 #include <iostream>
 #include <iomanip>
-#include <deque>
+#include <array>
 #include <vector>
 #include <algorithm>
+#include <bit>
 #include <iterator>
 #include <sstream>
 #include <cassert>
 #include <stdexcept>
+#include <unordered_set>
 #include <landstalker/misc/BitBarrel.h>
 #include <landstalker/misc/BitBarrelWriter.h>
 #include <landstalker/blockset/Block.h>
@@ -19,44 +21,78 @@
 
 namespace Landstalker {
 
+// Move-to-front queue of recently used tiles. Stored as a ring buffer so
+// that pushing a new tile only moves the head, and promoting an entry only
+// shifts the entries in front of it.
 template<class T, size_t N>
 class TileQueue
 {
+    static_assert((N & (N - 1)) == 0, "TileQueue size must be a power of two");
 public:
     TileQueue()
-    : d(std::deque<T>(N,0))
+    : d{},
+      head(0)
     {
     }
     void push(int x)
     {
-        d.push_front(static_cast<T>(x));
-        d.erase(d.end() - 1);
+        // The new front overwrites the oldest entry
+        head = (head + N - 1) & (N - 1);
+        d[head] = static_cast<T>(x);
     }
     void moveToFront(int x)
     {
-        std::rotate(d.begin(), d.begin() + x, d.begin() + x + 1);
+        const T val = at(x);
+        for (size_t i = x; i > 0; --i)
+        {
+            at(i) = at(i - 1);
+        }
+        at(0) = val;
     }
-    uint16_t front()
+    uint16_t front() const
     {
-        return d.front();
+        return d[head];
     }
-    int find(const T& param)
+    int find(const T& param, size_t start = 0) const
     {
-        typename std::deque<T>::const_iterator it;
-        it = std::find(d.begin(), d.end(), param);
-        if(it == d.end()) return -1;
-        return it - d.begin();
+        for (size_t i = start; i < N; ++i)
+        {
+            if (at(i) == param) return static_cast<int>(i);
+        }
+        return -1;
+    }
+    uint64_t hash() const
+    {
+        uint64_t h = 0xCBF29CE484222325ULL;
+        for (size_t i = 0; i < N; ++i)
+        {
+            h = (h ^ at(i)) * 0x100000001B3ULL;
+        }
+        return h;
     }
     template <class T1, size_t N1>
     friend std::ostream& operator<< (std::ostream& str, const TileQueue<T1, N1>& rhs);
 private:
-    std::deque<T> d;  
+    T& at(size_t i)
+    {
+        return d[(head + i) & (N - 1)];
+    }
+    const T& at(size_t i) const
+    {
+        return d[(head + i) & (N - 1)];
+    }
+
+    std::array<T, N> d;
+    size_t head;
 };
 
 template<class T1, size_t N1>
 static std::ostream& operator<< (std::ostream& str, const TileQueue<T1, N1>& rhs)
 {
-    std::copy (rhs.d.begin(), rhs.d.end(), std::ostream_iterator<uint16_t>(str, ":"));
+    for (size_t i = 0; i < N1; ++i)
+    {
+        str << static_cast<uint16_t>(rhs.at(i)) << ":";
+    }
     return str;
 }
 
@@ -78,10 +114,13 @@ static unsigned int ilog2(unsigned int in)
 static uint16_t getCompNumber(BitBarrel& bb)
 {
     int16_t exponent = 0, mantissa = 0;
-    while(bb.getNextBit() == false)
+    const uint32_t prefix = bb.peekBits(32);
+    if (prefix == 0)
     {
-        exponent++;
+        throw std::runtime_error(bb.overrun() ? "Unexpected end of input data" : "Bad number in compressed blockset data");
     }
+    exponent = static_cast<int16_t>(std::countl_zero(prefix));
+    bb.skipBits(exponent + 1);
     if(!exponent) return 0;
     
     uint16_t val = 1 << exponent;
@@ -95,15 +134,10 @@ static uint16_t getCompNumber(BitBarrel& bb)
 static void writeCompNumber(BitBarrelWriter& bb, uint16_t val)
 {
     uint16_t exp = static_cast<uint16_t>(ilog2(val) - 1);
-    uint16_t i = exp;
     uint16_t num = val - (1 << exp);
 
-
-    while (i--)
-    {
-        bb.WriteBits(0, 1);
-    }
-    bb.WriteBits(1, 1);
+    // exp zeroes followed by a one
+    bb.WriteBits(1, exp + 1);
 
     if (exp)
     {
@@ -113,14 +147,18 @@ static void writeCompNumber(BitBarrelWriter& bb, uint16_t val)
 
 static uint16_t decodeTile(TileQueue<uint16_t, 16>& tq, BitBarrel& bb)
 {
-    if(bb.getNextBit())
+    // Either a 1 followed by a 4-bit queue index, or a 0 followed by an 11-bit tile
+    const uint16_t code = static_cast<uint16_t>(bb.peekBits(12));
+    if(code & 0x800)
     {
-        uint8_t idx = static_cast<uint8_t>(bb.readBits(4));
+        uint8_t idx = static_cast<uint8_t>((code >> 7) & 0x0F);
+        bb.skipBits(5);
         if(idx) tq.moveToFront(idx);
     }
     else
     {
-        uint16_t val = static_cast<uint16_t>(bb.readBits(11));
+        uint16_t val = static_cast<uint16_t>(code & 0x7FF);
+        bb.skipBits(12);
         tq.push(val);
     }
     return tq.front();
@@ -187,7 +225,7 @@ static void maskTiles(std::vector<Tile>& tiles, const TileAttributes::Attribute&
 
 uint16_t BlocksetCmp::Decode(const uint8_t* src, size_t length, Blockset& blocks)
 {
-    BitBarrel bb(src);
+    BitBarrel bb(src, length);
     TileQueue<uint16_t, 16> tq;
     std::vector<Tile> new_tiles;
     
@@ -206,6 +244,11 @@ uint16_t BlocksetCmp::Decode(const uint8_t* src, size_t length, Blockset& blocks
     maskTiles(new_tiles, TileAttributes::Attribute::ATTR_HFLIP, bb);
     
     decompressTiles(new_tiles, bb);
+
+    if (bb.overrun())
+    {
+        throw std::runtime_error("Unexpected end of input data");
+    }
     
     std::ostringstream ss;
     std::vector<Tile>::const_iterator it;
@@ -289,9 +332,172 @@ static void CompressTiles(const Blockset& blocks, BitBarrelWriter& cbs)
     }
 }
 
-uint16_t BlocksetCmp::Encode(const Blockset& blocks, uint8_t* dst, size_t bufsize)
+// Choices made by the optimising encoder for each tile reference: a queue
+// index, a literal tile, or (for the second tile of a pair) the implied tile
+static const uint8_t CHOICE_LITERAL = 0xFF;
+static const uint8_t CHOICE_IMPLIED = 0xFE;
+static const size_t SEARCH_BEAM_WIDTH = 64;
+
+struct TileStep
+{
+    uint16_t tile;
+    bool second;   // Second tile of a pair, preceded by a one-bit flag
+    bool implied;  // Second tile that matches the one the decoder predicts
+};
+
+static std::vector<TileStep> GetTileSteps(const Blockset& blocks)
+{
+    std::vector<TileStep> steps;
+    steps.reserve(blocks.size() * 4);
+    for (const auto& block : blocks)
+    {
+        for (size_t i = 0; i < 4; i += 2)
+        {
+            uint16_t next = block.GetTile(i).GetIndex();
+            steps.push_back({next, false, false});
+            if (block.GetTile(i).Attributes().getAttribute(TileAttributes::Attribute::ATTR_HFLIP))
+            {
+                next--;
+            }
+            else
+            {
+                next++;
+            }
+            steps.push_back({block.GetTile(i + 1).GetIndex(), true, block.GetTile(i + 1).GetIndex() == next});
+        }
+    }
+    return steps;
+}
+
+// Size in bits of the tile stream written by CompressTiles
+static size_t GetGreedyTileBits(const std::vector<TileStep>& steps)
 {
-    BitBarrelWriter cbs;
+    TileQueue<uint16_t, 16> tq;
+    size_t bits = 0;
+    for (const auto& step : steps)
+    {
+        bits += step.second ? 1 : 0;
+        if (step.implied)
+        {
+            continue;
+        }
+        int tq_idx = tq.find(step.tile);
+        if (tq_idx == -1)
+        {
+            bits += 12;
+            tq.push(step.tile);
+        }
+        else
+        {
+            bits += 5;
+            if (tq_idx) tq.moveToFront(tq_idx);
+        }
+    }
+    return bits;
+}
+
+// Beam search over the ways each tile can be sent: any queue slot holding
+// it, a literal (which also evicts the oldest entry), or for an implied
+// second tile, an explicit reference that refreshes its queue position.
+// States with identical queues are interchangeable, so only the cheapest
+// is kept. Returns one choice per step.
+static std::vector<uint8_t> SearchTileChoices(const std::vector<TileStep>& steps, size_t& best_bits)
+{
+    struct Node
+    {
+        uint32_t parent;
+        uint8_t choice;
+    };
+    struct State
+    {
+        TileQueue<uint16_t, 16> tq;
+        size_t bits;
+        uint32_t node;
+        uint32_t parent;
+        uint8_t choice;
+    };
+    std::vector<Node> nodes;
+    std::vector<State> states(1, State{TileQueue<uint16_t, 16>(), 0, 0, 0, 0});
+    std::vector<State> candidates;
+    std::unordered_set<uint64_t> seen;
+    nodes.push_back({0, 0});
+
+    for (const auto& step : steps)
+    {
+        candidates.clear();
+        const size_t flag_bits = step.second ? 1 : 0;
+        for (const auto& state : states)
+        {
+            if (step.implied)
+            {
+                candidates.push_back({state.tq, state.bits + flag_bits, 0, state.node, CHOICE_IMPLIED});
+            }
+            for (int idx = state.tq.find(step.tile); idx != -1; idx = state.tq.find(step.tile, idx + 1))
+            {
+                State next{state.tq, state.bits + flag_bits + 5, 0, state.node, static_cast<uint8_t>(idx)};
+                if (idx) next.tq.moveToFront(idx);
+                candidates.push_back(next);
+            }
+            State next{state.tq, state.bits + flag_bits + 12, 0, state.node, CHOICE_LITERAL};
+            next.tq.push(step.tile);
+            candidates.push_back(next);
+        }
+        std::stable_sort(candidates.begin(), candidates.end(), [](const State& lhs, const State& rhs)
+        {
+            return lhs.bits < rhs.bits;
+        });
+        states.clear();
+        seen.clear();
+        for (auto& candidate : candidates)
+        {
+            if (!seen.insert(candidate.tq.hash()).second)
+            {
+                continue;
+            }
+            candidate.node = static_cast<uint32_t>(nodes.size());
+            nodes.push_back({candidate.parent, candidate.choice});
+            states.push_back(candidate);
+            if (states.size() == SEARCH_BEAM_WIDTH)
+            {
+                break;
+            }
+        }
+    }
+
+    best_bits = states.front().bits;
+    std::vector<uint8_t> choices(steps.size());
+    uint32_t node = states.front().node;
+    for (size_t i = steps.size(); i > 0; --i)
+    {
+        choices[i - 1] = nodes[node].choice;
+        node = nodes[node].parent;
+    }
+    return choices;
+}
+
+static void WriteTileChoices(const std::vector<TileStep>& steps, const std::vector<uint8_t>& choices, BitBarrelWriter& cbs)
+{
+    for (size_t i = 0; i < steps.size(); ++i)
+    {
+        if (steps[i].second)
+        {
+            cbs.WriteBits(choices[i] == CHOICE_IMPLIED ? 1 : 0, 1);
+        }
+        if (choices[i] == CHOICE_LITERAL)
+        {
+            cbs.WriteBits(steps[i].tile, 12);
+        }
+        else if (choices[i] != CHOICE_IMPLIED)
+        {
+            cbs.WriteBits(1, 1);
+            cbs.WriteBits(choices[i], 4);
+        }
+    }
+}
+
+uint16_t BlocksetCmp::Encode(const Blockset& blocks, uint8_t* dst, size_t bufsize, Compression mode)
+{
+    BitBarrelWriter cbs({dst, bufsize});
     // STEP 1: Write out total blocks
     cbs.Write<uint16_t>(static_cast<uint16_t>(blocks.size()));
     // STEP 2: Calculate mask for PRIORITY
@@ -301,16 +507,28 @@ uint16_t BlocksetCmp::Encode(const Blockset& blocks, uint8_t* dst, size_t bufsiz
     // STEP 4: Calculate mask for HFLIP
     SetMask(blocks, TileAttributes::Attribute::ATTR_HFLIP, cbs);
     // STEP 5: Encode tile values
-    CompressTiles(blocks, cbs);
-    // Done!
-    if (cbs.GetByteCount() <= bufsize)
+    if (mode == Compression::OPTIMISED)
     {
-        std::copy(cbs.Begin(), cbs.End(), dst);
+        // The attribute masks have exactly one encoding, so only the tile
+        // stream is open to search. Keep the greedy stream unless beaten.
+        const auto steps = GetTileSteps(blocks);
+        size_t search_bits = 0;
+        const auto choices = SearchTileChoices(steps, search_bits);
+        if (search_bits < GetGreedyTileBits(steps))
+        {
+            WriteTileChoices(steps, choices, cbs);
+        }
+        else
+        {
+            CompressTiles(blocks, cbs);
+        }
     }
     else
     {
-        throw std::runtime_error("Output buffer not large enough to hold result.");
+        CompressTiles(blocks, cbs);
     }
+    // Done!
+    cbs.Flush();
     return static_cast<uint16_t>(cbs.GetByteCount());
 }
 
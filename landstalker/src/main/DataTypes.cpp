@@ -1,5 +1,8 @@
 #include <landstalker/main/DataTypes.h>
 
+#include <utility>
+#include <algorithm>
+
 namespace Landstalker {
 
 std::shared_ptr<TilesetEntry> TilesetEntry::Create(DataManager* owner, const ByteVector& b, const std::string& name, const std::filesystem::path& filename, bool compressed, std::size_t width, std::size_t height, uint8_t bit_depth, Tileset::BlockType blocktype)
@@ -11,7 +14,7 @@ std::shared_ptr<TilesetEntry> TilesetEntry::Create(DataManager* owner, const Byt
 
 bool TilesetEntry::Serialise(const std::shared_ptr<Tileset> in, ByteVectorPtr out)
 {
-	*out = in->GetBits(m_compressed);
+	*out = in->GetBits(m_compressed, GetCompressionLevel());
 	return true;
 }
 
@@ -65,6 +68,44 @@ bool BlocksetEntry::Deserialise(const ByteVectorPtr in, std::shared_ptr<Blockset
 	return true;
 }
 
+std::shared_ptr<const Blockset> CombinedBlocksetCache::Get(const std::shared_ptr<BlocksetEntry>& pri, const std::shared_ptr<BlocksetEntry>& sec) const
+{
+	const auto key = std::make_pair<const BlocksetEntry*, const BlocksetEntry*>(pri.get(), sec.get());
+	const uint32_t pri_revision = pri->GetRevision();
+	const uint32_t sec_revision = sec->GetRevision();
+	const Blockset& pri_data = *pri->GetData();
+	const Blockset& sec_data = *sec->GetData();
+
+	std::lock_guard<std::mutex> guard(m_lock);
+	auto it = m_cache.find(key);
+	// A live weak pointer means the address hasn't been reused by another entry
+	if (it != m_cache.end() && !it->second.pri.expired() && !it->second.sec.expired() &&
+		it->second.pri_revision == pri_revision && it->second.sec_revision == sec_revision)
+	{
+		// Comparing costs no allocation, unlike handing out a rebuilt copy
+		const Blockset& cached = *it->second.blockset;
+		if (cached.size() == pri_data.size() + sec_data.size() &&
+			std::equal(pri_data.cbegin(), pri_data.cend(), cached.cbegin()) &&
+			std::equal(sec_data.cbegin(), sec_data.cend(), cached.cbegin() + pri_data.size()))
+		{
+			return it->second.blockset;
+		}
+	}
+
+	// Drop pairs whose entries have gone while we're rebuilding anyway
+	std::erase_if(m_cache, [](const auto& item)
+	{
+		return item.second.pri.expired() || item.second.sec.expired();
+	});
+
+	auto blockset = std::make_shared<Blockset>();
+	blockset->reserve(pri_data.size() + sec_data.size());
+	blockset->insert(blockset->end(), pri_data.cbegin(), pri_data.cend());
+	blockset->insert(blockset->end(), sec_data.cbegin(), sec_data.cend());
+	m_cache[key] = Combined{ pri, sec, pri_revision, sec_revision, blockset };
+	return blockset;
+}
+
 std::shared_ptr<Tilemap3DEntry> Tilemap3DEntry::Create(DataManager* owner, const ByteVector& b, const std::string& name, const std::filesystem::path& filename)
 {
 	auto o = std::make_shared<Tilemap3DEntry>(owner, b, name, filename);
@@ -83,7 +124,7 @@ bool Tilemap3DEntry::Serialise(const std::shared_ptr<Tilemap3D> in, ByteVectorPt
 bool Tilemap3DEntry::Deserialise(const ByteVectorPtr in, std::shared_ptr<Tilemap3D>& out)
 {
 	out = std::make_shared<Tilemap3D>();
-	uint16_t len = out->Decode(&in->at(0));
+	std::size_t len = out->Decode(*in);
 	in->resize(len);
 	return true;
 }
@@ -123,7 +164,7 @@ std::shared_ptr<Tilemap2DEntry> Tilemap2DEntry::Create(DataManager* owner, const
 bool Tilemap2DEntry::Serialise(const std::shared_ptr<Tilemap2D> in, ByteVectorPtr out)
 {
 	out->clear();
-	in->GetBits(*out, in->GetCompression());
+	in->GetBits(*out, in->GetCompression(), GetCompressionLevel());
 	return true;
 }
 
@@ -148,7 +189,7 @@ std::shared_ptr<SpriteFrameEntry> SpriteFrameEntry::Create(DataManager* owner, c
 
 bool SpriteFrameEntry::Serialise(const std::shared_ptr<SpriteFrame> in, ByteVectorPtr out)
 {
-	*out = in->GetBits();
+	*out = in->GetBits(in->GetCompressed(), GetCompressionLevel());
 	return true;
 }
 
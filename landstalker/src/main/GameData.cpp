@@ -35,7 +35,7 @@ bool GameData::Open(const std::filesystem::path& asm_file)
 		SetProgress("Opening ASM project...", 0.0);
 		DataManager::Open(asm_file);
 		SetProgress("Loading Room data from ASM...", 0.0);
-		m_rd = std::make_shared<RoomData>(asm_file);
+		m_rd = std::make_shared<RoomData>(asm_file, GetWorkerCount());
 		m_data.push_back(m_rd);
 		SetProgress("Loading Graphics data from ASM...", 1.0 / 5.0);
 		m_gd = std::make_shared<GraphicsData>(asm_file);
@@ -49,6 +49,7 @@ bool GameData::Open(const std::filesystem::path& asm_file)
 		SetProgress("Loading Script data from ASM...", 4.0 / 5.0);
 		m_scd = std::make_shared<ScriptData>(asm_file);
 		m_data.push_back(m_scd);
+		SetCompressionLevel(GetCompressionLevel());
 		CacheData();
 		SetDefaults();
 		SetProgress("Done", 1.0);
@@ -75,7 +76,7 @@ bool GameData::Open(const Rom& rom)
 		SetProgress("Opening ROM project...", 0.0);
 		DataManager::Open(rom);
 		SetProgress("Loading Room data from ROM...", 0.0);
-		m_rd = std::make_shared<RoomData>(rom);
+		m_rd = std::make_shared<RoomData>(rom, GetWorkerCount());
 		m_data.push_back(m_rd);
 		SetProgress("Loading Graphics data from ROM...", 1.0 / 5.0);
 		m_gd = std::make_shared<GraphicsData>(rom);
@@ -89,6 +90,7 @@ bool GameData::Open(const Rom& rom)
 		SetProgress("Loading Script data from ASM...", 4.0 / 5.0);
 		m_scd = std::make_shared<ScriptData>(rom);
 		m_data.push_back(m_scd);
+		SetCompressionLevel(GetCompressionLevel());
 		CacheData();
 		SetDefaults();
 		SetProgress("Done", 1.0);
@@ -209,6 +211,15 @@ void GameData::RefreshPendingWrites(const Rom& rom)
 		});
 }
 
+void GameData::SetCompressionLevel(LZ77::Level level)
+{
+	DataManager::SetCompressionLevel(level);
+	std::for_each(m_data.begin(), m_data.end(), [&](auto& d)
+		{
+			d->SetCompressionLevel(level);
+		});
+}
+
 const std::map<std::string, std::shared_ptr<PaletteEntry>>& GameData::GetAllPalettes() const
 {
 	return m_palettes;
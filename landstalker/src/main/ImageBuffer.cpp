@@ -4,6 +4,12 @@
 #include <cstring>
 #include <png.h>
 #include <numeric>
+#include <algorithm>
+#include <thread>
+#include <array>
+#include <stdexcept>
+#include <exception>
+#include <functional>
 #include <landstalker/misc/Utils.h>
 
 #if defined(_MSC_VER)
@@ -18,6 +24,157 @@
 
 namespace Landstalker {
 
+namespace
+{
+// Copies one tile row into the buffer. Each combination of flip, colour remap
+// and transparency gets its own loop so the common cases compile down to a
+// straight copy with no per-pixel branching.
+template <bool HFLIP, bool REMAP, bool ALPHA>
+void BlitTileRow(const uint8_t* src, std::size_t width, const uint8_t* cmap, uint8_t pal_bits,
+                 uint8_t priority, uint8_t* dest, uint8_t* pri_dest)
+{
+    for (std::size_t col = 0; col < width; ++col)
+    {
+        const uint8_t index = src[HFLIP ? width - 1 - col : col];
+        const uint8_t colour = REMAP ? cmap[index] : index;
+        if (!ALPHA || (colour != 0))
+        {
+            dest[col] = colour | pal_bits;
+            pri_dest[col] = priority;
+        }
+    }
+}
+
+// 0xFF in every byte of the row that holds a non-zero pixel
+uint64_t OpaqueMask(uint64_t pixels)
+{
+    constexpr uint64_t LOW_BITS = 0x7F7F7F7F7F7F7F7FULL;
+    constexpr uint64_t TOP_BITS = 0x8080808080808080ULL;
+    const uint64_t nonzero = (((pixels & LOW_BITS) + LOW_BITS) | pixels) & TOP_BITS;
+    return (nonzero >> 7) * 0xFF;
+}
+
+// Draws a tile from the tileset's render cache eight pixels at a time
+void BlitRenderedTile(std::span<const uint64_t> rows, std::size_t stride, uint8_t pal_bits,
+                      uint8_t priority, bool use_alpha, uint8_t* dest, uint8_t* pri_dest)
+{
+    constexpr uint64_t EVERY_BYTE = 0x0101010101010101ULL;
+    const uint64_t pal = EVERY_BYTE * pal_bits;
+    const uint64_t pri = EVERY_BYTE * priority;
+    for (const uint64_t row : rows)
+    {
+        if (!use_alpha)
+        {
+            const uint64_t pixels = row | pal;
+            std::memcpy(dest, &pixels, sizeof(pixels));
+            std::memcpy(pri_dest, &pri, sizeof(pri));
+        }
+        else if (const uint64_t opaque = OpaqueMask(row); opaque != 0)
+        {
+            uint64_t pixels, priorities;
+            std::memcpy(&pixels, dest, sizeof(pixels));
+            std::memcpy(&priorities, pri_dest, sizeof(priorities));
+            pixels = (pixels & ~opaque) | ((row | pal) & opaque);
+            priorities = (priorities & ~opaque) | (pri & opaque);
+            std::memcpy(dest, &pixels, sizeof(pixels));
+            std::memcpy(pri_dest, &priorities, sizeof(priorities));
+        }
+        dest += stride;
+        pri_dest += stride;
+    }
+}
+
+// The 32-bit colour of every possible pixel value, laid out in memory in the
+// requested channel order. The second half holds high priority pixels, whose
+// alpha is capped separately. Pixel values with no palette are transparent.
+std::array<uint32_t, 512> MakeColourTable(const std::vector<std::shared_ptr<Palette>>& pals, ImageBuffer::PixelFormat format,
+                                          uint8_t low_pri_max_opacity, uint8_t high_pri_max_opacity)
+{
+    std::array<uint32_t, 512> table{};
+    const std::size_t count = std::min<std::size_t>(pals.size() * 16, 256);
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        const auto& pal = *pals[i / 16];
+        const uint8_t index = static_cast<uint8_t>(i % 16);
+        const uint8_t r = pal.getR(index);
+        const uint8_t b = pal.getB(index);
+        std::array<uint8_t, 4> colour = {
+            format == ImageBuffer::PixelFormat::RGBA ? r : b,
+            pal.getG(index),
+            format == ImageBuffer::PixelFormat::RGBA ? b : r,
+            std::min(low_pri_max_opacity, pal.getA(index))
+        };
+        std::memcpy(&table[i], colour.data(), colour.size());
+        colour[3] = std::min(high_pri_max_opacity, pal.getA(index));
+        std::memcpy(&table[i + 256], colour.data(), colour.size());
+    }
+    return table;
+}
+
+// libpng hands encoded PNG data to this. Any exception from the caller's
+// writer is parked and turned into a libpng error, as it can't be thrown
+// through libpng itself.
+struct PngWriter
+{
+    const std::function<void(std::span<const uint8_t>)>& write;
+    std::exception_ptr error;
+};
+
+void WritePngData(png_structp png, png_bytep data, png_size_t length)
+{
+    auto* writer = static_cast<PngWriter*>(png_get_io_ptr(png));
+    bool failed = false;
+    try
+    {
+        writer->write(std::span<const uint8_t>(data, length));
+    }
+    catch (...)
+    {
+        writer->error = std::current_exception();
+        failed = true;
+    }
+    if (failed)
+    {
+        png_error(png, "PNG output failed");
+    }
+}
+
+void FlushPngData(png_structp)
+{
+}
+
+int GetPngFilter(PngOptions::Filter filter)
+{
+    switch (filter)
+    {
+    case PngOptions::Filter::NONE:
+        return PNG_FILTER_NONE;
+    case PngOptions::Filter::SUB:
+        return PNG_FILTER_SUB;
+    case PngOptions::Filter::UP:
+        return PNG_FILTER_UP;
+    case PngOptions::Filter::AVERAGE:
+        return PNG_FILTER_AVG;
+    case PngOptions::Filter::PAETH:
+        return PNG_FILTER_PAETH;
+    case PngOptions::Filter::ADAPTIVE:
+    default:
+        return PNG_ALL_FILTERS;
+    }
+}
+
+using RowBlitter = void (*)(const uint8_t*, std::size_t, const uint8_t*, uint8_t, uint8_t, uint8_t*, uint8_t*);
+
+// Indexed by [hflip][remap][alpha]
+constexpr RowBlitter ROW_BLITTERS[2][2][2] =
+{
+    {{BlitTileRow<false, false, false>, BlitTileRow<false, false, true>},
+     {BlitTileRow<false, true,  false>, BlitTileRow<false, true,  true>}},
+    {{BlitTileRow<true,  false, false>, BlitTileRow<true,  false, true>},
+     {BlitTileRow<true,  true,  false>, BlitTileRow<true,  true,  true>}}
+};
+} // namespace
+
 ImageBuffer::ImageBuffer()
     : m_width(0), m_height(0)
 {}
@@ -56,52 +213,67 @@ void ImageBuffer::PutPixel(std::size_t x, std::size_t y, uint8_t colour)
 
 void ImageBuffer::InsertTile(int x, int y, uint8_t palette_index, const Tile& tile, const Tileset& tileset, bool use_alpha, BlockMode mode)
 {
-	int max_x = x + 7;
-	int max_y = y + 7;
-    std::vector<uint8_t> cmap = tileset.GetColourIndicies();
+    DrawTile(x, y, palette_index, tile, tileset, use_alpha, mode, { 0, m_height });
+}
+
+void ImageBuffer::DrawTile(int x, int y, uint8_t palette_index, const Tile& tile, const Tileset& tileset, bool use_alpha, BlockMode mode, const RowRange& rows)
+{
+	int max_x = x + static_cast<int>(tileset.GetTileWidth()) - 1;
+	int max_y = y + static_cast<int>(tileset.GetTileHeight()) - 1;
     if ((mode == BlockMode::PRIORITY_ONLY && tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_PRIORITY) == 0) ||
         (mode == BlockMode::NO_PRIORITY_ONLY && tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_PRIORITY) != 0))
     {
         return;
     }
-    if (cmap.empty())
+    if ((max_x >= static_cast<int>(m_width)) || (max_y >= static_cast<int>(m_height)) || (x < 0 ) || (y < 0))
     {
-        cmap = tileset.GetDefaultColourIndicies();
+        if (rows.begin == 0)
+        {
+            std::ostringstream ss;
+            ss << "Attempt to draw tile in out-of-range position " << x << ", " << y
+               << " : The image buffer is only " << m_width << " x " << m_height << " pixels." << std::endl;
+            Debug(ss.str());
+        }
+        return;
     }
-    if ((max_x >= static_cast<int>(m_width)) || (max_y >= static_cast<int>(m_height)) || (x < 0 ) || (y < 0))
+    // Only the tile's rows that fall within the range are drawn
+    const std::size_t first = std::max<std::size_t>(rows.begin, y) - y;
+    const std::size_t last = std::min<std::size_t>(rows.end, y + tileset.GetTileHeight());
+    if (first + y >= last)
     {
-        std::ostringstream ss;
-        ss << "Attempt to draw tile in out-of-range position " << x << ", " << y 
-           << " : The image buffer is only " << m_width << " x " << m_height << " pixels." << std::endl;
-        Debug(ss.str());
+        return;
     }
-    else
+    const std::size_t count = last - y - first;
+	const uint8_t pal_bits = palette_index << 4;
+    const uint8_t priority = tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_PRIORITY);
+    const std::size_t offset = (y + first) * m_width + x;
+    // Out-of-range tiles draw as tile 0. A tile can straddle bands, so only
+    // the band holding its top row reports it.
+    Tile source = tile;
+    if (tile.GetIndex() >= tileset.GetTileCount())
     {
-	    auto tile_bits = tileset.GetTile(tile);
-	    const uint8_t pal_bits = palette_index << 4;
-        std::size_t begin_offset = y * m_width + x;
-        auto row_it = m_pixels.begin() + begin_offset;
-        auto dest_it = row_it;
-        auto pri_row_it = m_priority.begin() + begin_offset;
-        auto pri_dest_it = row_it;
-        uint8_t priority = tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_PRIORITY);
-        for (std::size_t i = 0; i < tile_bits.size(); ++i)
+        if (first == 0)
         {
-            if (i % tileset.GetTileWidth() == 0)
-            {
-                dest_it = row_it + m_width * (i / tileset.GetTileWidth());
-                pri_dest_it = pri_row_it + m_width * (i / tileset.GetTileWidth());
-				y++;
-				x -= tileset.GetTileWidth();
-            }
-            if (!use_alpha || (cmap[tile_bits[i]] != 0))
-            {
-                *dest_it = cmap[tile_bits[i]] | pal_bits;
-                *pri_dest_it = priority;
-            }
-            dest_it++;
-            pri_dest_it++;
+            std::ostringstream ss;
+            ss << "Attempt to draw out-of-range tile " << tile.GetIndex();
+            Debug(ss.str());
         }
+        source.SetIndex(0);
+    }
+    if (const auto rendered = tileset.GetRenderedTile(source); !rendered.empty())
+    {
+        BlitRenderedTile(rendered.subspan(first, count), m_width, pal_bits, priority, use_alpha,
+            m_pixels.data() + offset, m_priority.data() + offset);
+        return;
+    }
+	const TileView view = tileset.GetTileView(source);
+    const auto& colours = tileset.GetColourIndicies();
+    const RowBlitter blit = ROW_BLITTERS[view.IsHFlipped()][!colours.empty()][use_alpha];
+    const std::size_t width = view.GetWidth();
+    for (std::size_t row = 0; row < count; ++row)
+    {
+        blit(view.GetSourceRow(first + row).data(), width, colours.data(), pal_bits, priority,
+             m_pixels.data() + offset + row * m_width, m_priority.data() + offset + row * m_width);
     }
 }
 
@@ -182,6 +354,16 @@ void ImageBuffer::InsertSprite(int x, int y, uint8_t palette_index, const Sprite
 }
 
 void ImageBuffer::InsertMap(int x, int y, uint8_t palette_index, const Tilemap2D& map, const Tileset& tileset)
+{
+    const auto bands = GetBands();
+    tileset.PrepareRenderCache();
+    ParallelFor(bands.size(), [&](std::size_t i)
+    {
+        DrawMap(x, y, palette_index, map, tileset, bands[i]);
+    }, m_worker_count);
+}
+
+void ImageBuffer::DrawMap(int x, int y, uint8_t palette_index, const Tilemap2D& map, const Tileset& tileset, const RowRange& rows)
 {
     for (std::size_t yy = 0; yy < map.GetHeight(); ++yy)
     {
@@ -189,7 +371,7 @@ void ImageBuffer::InsertMap(int x, int y, uint8_t palette_index, const Tilemap2D
         {
             const int xpos = x + xx * tileset.GetTileWidth();
             const int ypos = y + yy * tileset.GetTileHeight();
-            InsertTile(xpos, ypos, palette_index, map.GetTile(xx, yy), tileset);
+            DrawTile(xpos, ypos, palette_index, map.GetTile(xx, yy), tileset, true, BlockMode::NORMAL, rows);
         }
     }
 }
@@ -198,177 +380,278 @@ void ImageBuffer::Insert3DMapLayer(int x, int y, uint8_t palette_index, Tilemap3
     const std::shared_ptr<const Tileset> tileset, const std::shared_ptr<const std::vector<MapBlock>> blockset, bool offset,
     std::optional<std::vector<TileSwap>> swaps, std::optional<std::vector<Door>> doors, ImageBuffer::BlockMode mode)
 {
-    Point2D tilepos = {0, 0};
-    Tilemap3D disp_map = *map;
+    Tilemap3DOverlay disp_map(*map, layer);
     if (swaps)
     {
         for (const auto& swap : *swaps)
         {
-            swap.DrawSwap(disp_map, layer);
+            swap.DrawSwap(disp_map);
         }
     }
     if (doors)
     {
         for (const auto& door : *doors)
         {
-            door.DrawDoor(disp_map, layer);
+            door.DrawDoor(disp_map);
         }
     }
+    const auto bands = GetBands();
+    tileset->PrepareRenderCache();
+    ParallelFor(bands.size(), [&](std::size_t i)
+    {
+        Draw3DMapLayer(x, y, palette_index, disp_map, *tileset, *blockset, offset, mode, bands[i]);
+    }, m_worker_count);
+}
+
+void ImageBuffer::Draw3DMapLayer(int x, int y, uint8_t palette_index, const Tilemap3DOverlay& disp_map, const Tileset& tileset,
+    const std::vector<MapBlock>& blockset, bool offset, BlockMode mode, const RowRange& rows)
+{
+    Point2D tilepos = {0, 0};
     for (int yy = 0; yy < disp_map.GetHeight(); ++yy)
         for (int xx = 0; xx < disp_map.GetWidth(); ++xx)
         {
             tilepos = { xx + x, yy + y };
-            auto tile = disp_map.GetBlock(tilepos, layer);
-            auto loc(disp_map.IsoToPixel(tilepos, layer, offset));
-            if (tile >= blockset->size())
+            auto tile = disp_map.GetBlock(tilepos);
+            auto loc(disp_map.GetMap().IsoToPixel(tilepos, disp_map.GetLayer(), offset));
+            if (tile >= blockset.size())
             {
-                std::ostringstream ss;
-                ss << "Attempt to index out of range block " << std::hex << tile << " - maximum is " << (blockset->size() - 1);
-                Debug(ss.str());
+                if (rows.begin == 0)
+                {
+                    std::ostringstream ss;
+                    ss << "Attempt to index out of range block " << std::hex << tile << " - maximum is " << (blockset.size() - 1);
+                    Debug(ss.str());
+                }
                 tile = 0;
             }
-            InsertBlock(loc.x, loc.y, palette_index, blockset->at(tile), *tileset, mode);
-            tilepos.x++;
-            if (tilepos.x == static_cast<int>(GetWidth()))
-            {
-                tilepos.x = 0;
-                tilepos.y++;
-            }
+            DrawBlock(loc.x, loc.y, palette_index, blockset.at(tile), tileset, mode, rows);
         }
 }
 
 bool ImageBuffer::WritePNG(const std::string& filename, const std::vector<std::shared_ptr<Palette>>& palettes, bool use_alpha)
 {
-    volatile bool retval = false;
-
-    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
-    png_infop info = png_create_info_struct(png);
-    if (setjmp(png_jmpbuf(png))) throw std::runtime_error("Unable to set libpng longjmp");
+    PngOptions options;
+    options.use_alpha = use_alpha;
+    options.trim_palette = false;
+    return WritePNG(filename, palettes, options);
+}
 
-    png_set_IHDR(
-        png,
-        info,
-        m_width, m_height,
-        8,
-        PNG_COLOR_TYPE_PALETTE,
-        PNG_INTERLACE_NONE,
-        PNG_COMPRESSION_TYPE_BASE,
-        PNG_FILTER_TYPE_BASE
-    );
+bool ImageBuffer::WritePNG(const std::string& filename, const std::vector<std::shared_ptr<Palette>>& palettes, const PngOptions& options)
+{
+    FILE* fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL)
+    {
+        Debug("Unable to open PNG!");
+        return false;
+    }
+    try
+    {
+        EncodePNG([fp](std::span<const uint8_t> bytes)
+        {
+            if (fwrite(bytes.data(), 1, bytes.size(), fp) != bytes.size())
+            {
+                throw std::runtime_error("Unable to write PNG");
+            }
+        }, palettes, options);
+    }
+    catch (...)
+    {
+        fclose(fp);
+        throw;
+    }
+    fclose(fp);
+    return true;
+}
 
-    png_color png_palette[256];
-    memset(png_palette, 0, sizeof(png_palette));
-    png_byte png_alpha[256];
-    memset(png_alpha, 0, sizeof(png_alpha));
+std::vector<uint8_t> ImageBuffer::EncodePNG(const std::vector<std::shared_ptr<Palette>>& palettes, const PngOptions& options) const
+{
+    std::vector<uint8_t> png;
+    EncodePNG([&png](std::span<const uint8_t> bytes)
+    {
+        png.insert(png.end(), bytes.begin(), bytes.end());
+    }, palettes, options);
+    return png;
+}
 
+void ImageBuffer::EncodePNG(const std::function<void(std::span<const uint8_t>)>& write, const std::vector<std::shared_ptr<Palette>>& palettes,
+    const PngOptions& options) const
+{
+    std::array<png_color, 256> png_palette{};
+    std::array<png_byte, 256> png_alpha{};
     std::size_t entry = 0;
     for (const auto& pal : palettes)
     {
-        for (std::size_t i = 0; i < 16; ++i)
+        for (std::size_t i = 0; i < 16 && entry < png_palette.size(); ++i, ++entry)
         {
-            png_palette[entry + i].red = pal->getR(i);
-            png_palette[entry + i].green = pal->getG(i);
-            png_palette[entry + i].blue = pal->getB(i);
-            png_alpha[entry + i] = pal->getA(i);
+            png_palette[entry].red = pal->getR(i);
+            png_palette[entry].green = pal->getG(i);
+            png_palette[entry].blue = pal->getB(i);
+            png_alpha[entry] = pal->getA(i);
         }
-        entry += 16;
     }
-    png_set_PLTE(png, info, png_palette, 256);
-    if (use_alpha)
-    {
-        png_set_tRNS(png, info, png_alpha, 256, NULL);
-    };
 
-    FILE* fp = fopen(filename.c_str(), "wb");
+    std::size_t palette_size = png_palette.size();
+    std::size_t alpha_size = png_alpha.size();
+    int bit_depth = 8;
+    if (options.trim_palette)
+    {
+        // Every palette passed in is kept, along with any pixel value beyond them
+        const std::size_t max_pixel = m_pixels.empty() ? 0 : *std::max_element(m_pixels.cbegin(), m_pixels.cend());
+        palette_size = std::clamp<std::size_t>(std::max(entry, max_pixel + 1), 1, png_palette.size());
+        bit_depth = palette_size <= 2 ? 1 : palette_size <= 4 ? 2 : palette_size <= 16 ? 4 : 8;
+        // Opaque entries at the end of the transparency table can be left off
+        alpha_size = palette_size;
+        while (alpha_size > 0 && png_alpha[alpha_size - 1] == 0xFF)
+        {
+            --alpha_size;
+        }
+    }
 
-    if (fp != NULL)
+    std::vector<png_bytep> rows(m_height);
+    for (std::size_t y = 0; y < m_height; ++y)
     {
-        png_init_io(png, fp);
-        png_write_info(png, info);
+        // libpng copies each row before filtering it, so never writes to these
+        rows[y] = const_cast<png_bytep>(m_pixels.data() + y * m_width);
+    }
 
-        const uint8_t* row = m_pixels.data();
-        for (std::size_t y = 0; y < m_height; ++y)
+    PngWriter writer{ write, nullptr };
+    png_structp png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    png_infop info = png ? png_create_info_struct(png) : NULL;
+    if (info == NULL)
+    {
+        png_destroy_write_struct(&png, NULL);
+        throw std::runtime_error("Unable to create libpng write structures");
+    }
+    if (setjmp(png_jmpbuf(png)))
+    {
+        png_destroy_write_struct(&png, &info);
+        if (writer.error)
         {
-            png_write_row(png, row);
-            row += m_width;
+            std::rethrow_exception(writer.error);
         }
+        throw std::runtime_error("Unable to encode PNG");
+    }
+    png_set_write_fn(png, &writer, WritePngData, FlushPngData);
 
-        png_write_end(png, info);
-        fclose(fp);
-        retval = true;
+    png_set_IHDR(
+        png,
+        info,
+        m_width, m_height,
+        bit_depth,
+        PNG_COLOR_TYPE_PALETTE,
+        PNG_INTERLACE_NONE,
+        PNG_COMPRESSION_TYPE_BASE,
+        PNG_FILTER_TYPE_BASE
+    );
+    png_set_PLTE(png, info, png_palette.data(), static_cast<int>(palette_size));
+    if (options.use_alpha && alpha_size > 0)
+    {
+        png_set_tRNS(png, info, png_alpha.data(), static_cast<int>(alpha_size), NULL);
     }
-    else
+    if (options.compression_level >= 0)
     {
-        Debug("Unable to open PNG!");
+        png_set_compression_level(png, std::min(options.compression_level, 9));
+    }
+    if (options.filter != PngOptions::Filter::DEFAULT)
+    {
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, GetPngFilter(options.filter));
     }
 
+    png_write_info(png, info);
+    if (bit_depth < 8)
+    {
+        png_set_packing(png);
+    }
+    png_write_image(png, rows.data());
+    png_write_end(png, info);
     png_destroy_write_struct(&png, &info);
-
-    return retval;
 }
 
 void ImageBuffer::InsertBlock(std::size_t x, std::size_t y, uint8_t palette_index, const MapBlock& block, const Tileset& tileset, BlockMode mode)
+{
+    DrawBlock(x, y, palette_index, block, tileset, mode, { 0, m_height });
+}
+
+void ImageBuffer::DrawBlock(std::size_t x, std::size_t y, uint8_t palette_index, const MapBlock& block, const Tileset& tileset, BlockMode mode, const RowRange& rows)
 {
     if ((y + 7) * m_width + x + 7 < m_pixels.size())
     {
-        InsertTile(x, y, palette_index, block.GetTile(0), tileset, true, mode);
-        InsertTile(x + 8, y, palette_index, block.GetTile(1), tileset, true, mode);
-        InsertTile(x, y + 8, palette_index, block.GetTile(2), tileset, true, mode);
-        InsertTile(x + 8, y + 8, palette_index, block.GetTile(3), tileset, true, mode);
+        DrawTile(x, y, palette_index, block.GetTile(0), tileset, true, mode, rows);
+        DrawTile(x + 8, y, palette_index, block.GetTile(1), tileset, true, mode, rows);
+        DrawTile(x, y + 8, palette_index, block.GetTile(2), tileset, true, mode, rows);
+        DrawTile(x + 8, y + 8, palette_index, block.GetTile(3), tileset, true, mode, rows);
     }
-    else
+    else if (rows.begin == 0)
     {
-        assert(true);
         Debug("Coordinates out of range");
     }
 }
 
+std::vector<ImageBuffer::RowRange> ImageBuffer::GetBands() const
+{
+    // Bands below this height aren't worth a thread of their own
+    constexpr std::size_t MIN_BAND_ROWS = 64;
+    const std::size_t workers = m_worker_count != 0 ? m_worker_count : std::max(1U, std::thread::hardware_concurrency());
+    const std::size_t count = std::clamp<std::size_t>(m_height / MIN_BAND_ROWS, 1, workers);
+    std::vector<RowRange> bands;
+    std::size_t begin = 0;
+    for (std::size_t i = 1; i <= count; ++i)
+    {
+        // Keep band edges on 8 pixel boundaries so tiles are rarely split
+        const std::size_t end = (i == count) ? m_height : (m_height * i / count) & ~std::size_t(7);
+        bands.push_back({ begin, end });
+        begin = end;
+    }
+    return bands;
+}
+
 const std::vector<uint8_t>& ImageBuffer::GetRGB(const std::vector<std::shared_ptr<Palette>>& pals) const
 {
+    const auto table = MakeColourTable(pals, PixelFormat::RGBA, 0xFF, 0xFF);
     m_rgb.resize(m_width * m_height * 3);
     auto it = m_rgb.begin();
-    std::unique_ptr<uint8_t[]> pal_lookup(new uint8_t[pals.size() * 16 * 4]);
-    int idx = 0;
-    for (const auto& p : pals)
-    {
-        for (int i = 0; i < 16; ++i)
-        {
-            pal_lookup[idx++] = p->getR(i);
-            pal_lookup[idx++] = p->getG(i);
-            pal_lookup[idx++] = p->getB(i);
-            pal_lookup[idx++] = 0;
-        }
-    }
     for (const auto& pixel : m_pixels)
     {
-        *it++ = pal_lookup[(pixel << 2)];
-        *it++ = pal_lookup[(pixel << 2) + 1];
-        *it++ = pal_lookup[(pixel << 2) + 2];
+        const auto* colour = reinterpret_cast<const uint8_t*>(&table[pixel]);
+        it = std::copy_n(colour, 3, it);
     }
     return m_rgb;
 }
 
 const std::vector<uint8_t>& ImageBuffer::GetAlpha(const std::vector<std::shared_ptr<Palette>>& pals, uint8_t low_pri_max_opacity, uint8_t high_pri_max_opacity) const
 {
+    const auto table = MakeColourTable(pals, PixelFormat::RGBA, low_pri_max_opacity, high_pri_max_opacity);
     m_alpha.resize(m_width * m_height);
-    auto pri = m_priority.cbegin();
-    auto it = m_alpha.begin();
-    std::unique_ptr<uint8_t[]> pal_lookup(new uint8_t[pals.size() * 16]);
-    int pi = 0;
-    for (const auto& p : pals)
+    for (std::size_t i = 0; i < m_pixels.size(); ++i)
     {
-        for (int i = 0; i < 16; ++i)
-        {
-            pal_lookup[pi++] = p->getA(i);
-        }
+        const std::size_t entry = (m_priority[i] != 0 ? 256 : 0) + m_pixels[i];
+        m_alpha[i] = reinterpret_cast<const uint8_t*>(&table[entry])[3];
     }
-    for (const auto& pixel : m_pixels)
+    return m_alpha;
+}
+
+void ImageBuffer::ConvertToRGBA(std::span<uint8_t> dest, const std::vector<std::shared_ptr<Palette>>& pals, PixelFormat format,
+    uint8_t low_pri_max_opacity, uint8_t high_pri_max_opacity, std::size_t stride) const
+{
+    if (stride == 0)
     {
-        uint8_t alpha = pal_lookup[pixel];
-        uint8_t max_opacity = *pri++ ? high_pri_max_opacity : low_pri_max_opacity;
-        *it++ = std::min<uint8_t>(max_opacity, alpha);
+        stride = m_width * 4;
+    }
+    if (stride < m_width * 4 || (m_height > 0 && dest.size() < (m_height - 1) * stride + m_width * 4))
+    {
+        throw std::runtime_error("RGBA destination is too small for the image buffer");
+    }
+    const auto table = MakeColourTable(pals, format, low_pri_max_opacity, high_pri_max_opacity);
+    for (std::size_t y = 0; y < m_height; ++y)
+    {
+        const uint8_t* pixels = m_pixels.data() + y * m_width;
+        const uint8_t* priorities = m_priority.data() + y * m_width;
+        uint8_t* out = dest.data() + y * stride;
+        for (std::size_t x = 0; x < m_width; ++x)
+        {
+            const uint32_t colour = table[(priorities[x] != 0 ? 256 : 0) + pixels[x]];
+            std::memcpy(out + x * 4, &colour, sizeof(colour));
+        }
     }
-    return m_alpha;
 }
 
 std::size_t ImageBuffer::GetHeight() const
@@ -137,9 +137,10 @@ ByteVector EncodeFromSet(const std::set<uint16_t>& data, bool terminate = true)
     return ret;
 }
 
-RoomData::RoomData(const std::filesystem::path& asm_file)
+RoomData::RoomData(const std::filesystem::path& asm_file, std::size_t worker_count)
     : DataManager("Room Data", asm_file)
 {
+    SetWorkerCount(worker_count);
     if (!LoadAsmFilenames())
     {
         throw std::runtime_error(std::string("Unable to load file data from \'") + asm_file.string() + '\'');
@@ -200,9 +201,10 @@ RoomData::RoomData(const std::filesystem::path& asm_file)
     ResetTilesetDefaultPalettes();
 }
 
-RoomData::RoomData(const Rom& rom)
+RoomData::RoomData(const Rom& rom, std::size_t worker_count)
     : DataManager("Room Data", rom)
 {
+    SetWorkerCount(worker_count);
     SetDefaultFilenames();
     if (!RomLoadRoomData(rom))
     {
@@ -829,24 +831,16 @@ std::list<std::shared_ptr<BlocksetEntry>> RoomData::GetBlocksetsForRoom(uint16_t
     return GetBlocksetsForRoom(rm->name);
 }
 
-std::shared_ptr<Blockset> RoomData::GetCombinedBlocksetForRoom(const std::string& name) const
+std::shared_ptr<const Blockset> RoomData::GetCombinedBlocksetForRoom(const std::string& name) const
 {
-    auto blockset = std::make_shared<Blockset>();
-    for (const auto& b : GetBlocksetsForRoom(name))
-    {
-        blockset->insert(blockset->end(), b->GetData()->cbegin(), b->GetData()->cend());
-    }
-    return blockset;
+    const auto blocksets = GetBlocksetsForRoom(name);
+    return m_combined_blocksets.Get(blocksets.front(), blocksets.back());
 }
 
-std::shared_ptr<Blockset> RoomData::GetCombinedBlocksetForRoom(uint16_t roomnum) const
+std::shared_ptr<const Blockset> RoomData::GetCombinedBlocksetForRoom(uint16_t roomnum) const
 {
-    auto blockset = std::make_shared<Blockset>();
-    for (const auto& b : GetBlocksetsForRoom(roomnum))
-    {
-        blockset->insert(blockset->end(), b->GetData()->cbegin(), b->GetData()->cend());
-    }
-    return blockset;
+    auto rm = GetRoom(roomnum);
+    return GetCombinedBlocksetForRoom(rm->name);
 }
 
 std::shared_ptr<Tilemap3DEntry> RoomData::GetMapForRoom(const std::string& name) const
@@ -1381,14 +1375,16 @@ bool RoomData::AsmLoadMaps()
         AsmFile file(GetBasePath() / m_map_data_filename);
         AsmFile::IncludeFile inc;
         AsmFile::Label lbl;
+        std::vector<std::shared_ptr<Tilemap3DEntry>> entries;
         while (file.IsGood())
         {
             file >> lbl >> inc;
             auto mapfile = GetBasePath() / inc.path;
-            auto raw_data = std::make_shared<std::vector<uint8_t>>(ReadBytes(mapfile));
-            auto map_entry = Tilemap3DEntry::Create(this, ReadBytes(mapfile), lbl, inc.path);
+            auto map_entry = std::make_shared<Tilemap3DEntry>(this, ReadBytes(mapfile), lbl, inc.path);
             m_maps[lbl] = map_entry;
+            entries.push_back(map_entry);
         }
+        InitialiseEntries(entries, "Decoding maps...");
         m_maps_orig = m_maps;
         return true;
     }
@@ -1479,12 +1475,15 @@ bool RoomData::AsmLoadBlocksetData()
         AsmFile dfile(GetBasePath() / m_blockset_data_filename);
         AsmFile::Label lbl;
         AsmFile::IncludeFile inc;
+        std::vector<std::shared_ptr<BlocksetEntry>> entries;
         while (dfile.IsGood())
         {
             dfile >> lbl >> inc;
-            auto ep = BlocksetEntry::Create(this, ReadBytes(GetBasePath() / inc.path), lbl, inc.path);
+            auto ep = std::make_shared<BlocksetEntry>(this, ReadBytes(GetBasePath() / inc.path), lbl, inc.path);
             m_blocksets_by_name.insert({ ep->GetName(), ep});
+            entries.push_back(ep);
         }
+        InitialiseEntries(entries, "Decoding blocksets...");
         m_blocksets_by_name_orig = m_blocksets_by_name;
         m_blocksets_orig = m_blocksets;
         return true;
@@ -1753,6 +1752,7 @@ bool RoomData::RomLoadRoomData(const Rom& rom)
             addr += 8;
         } while (addr < table_end_addr);
         std::map<std::string, std::string> map_names;
+        std::vector<std::shared_ptr<Tilemap3DEntry>> entries;
         unsigned int count = 0;
         for (auto it = map_list.begin(); it != map_list.end(); ++it)
         {
@@ -1770,10 +1770,12 @@ bool RoomData::RomLoadRoomData(const Rom& rom)
             map_names[Hex(begin)] = name;
             auto fname = StrPrintf(RomLabels::Rooms::MAP_FILENAME_FORMAT_STRING, name.c_str());
             std::transform(fname.begin(), fname.end(), fname.begin(), [](const unsigned char i) { return static_cast<unsigned char>(std::tolower(i)); });
-            auto map_entry = Tilemap3DEntry::Create(this, rom.read_array<uint8_t>(begin, end - begin), name, fname);
+            auto map_entry = std::make_shared<Tilemap3DEntry>(this, rom.read_array<uint8_t>(begin, end - begin), name, fname);
             map_entry->SetStartAddress(begin);
             m_maps.insert(std::make_pair(name, map_entry));
+            entries.push_back(map_entry);
         }
+        InitialiseEntries(entries, "Decoding maps...");
         for (auto& room : m_roomlist)
         {
             room->map = map_names[room->map];
@@ -1890,6 +1892,12 @@ bool RoomData::RomLoadBlocksetData(const Rom& rom)
             return false;
         }
     }
+    std::vector<std::shared_ptr<BlocksetEntry>> entries;
+    for (const auto& b : m_blocksets_by_name)
+    {
+        entries.push_back(b.second);
+    }
+    InitialiseEntries(entries, "Decoding blocksets...");
     m_blocksets_by_name_orig = m_blocksets_by_name;
     m_blocksets_orig = m_blocksets;
     return true;
@@ -1899,7 +1907,8 @@ bool RoomData::RomLoadBlockset(const Rom& rom, uint8_t pri, uint8_t sec, uint32_
 {
     std::string name = StrPrintf(RomLabels::Blocksets::BLOCKSET_LABEL, (pri & 0x1F) + 1, sec + 10 * (pri >> 5));
     std::filesystem::path filename = StrPrintf(RomLabels::Blocksets::BLOCKSET_FILE, (pri & 0x1F) + 1, sec + 10 * (pri >> 5));
-    auto e = BlocksetEntry::Create(this, rom.read_array<uint8_t>(begin, end - begin), name, filename);
+    // Decoded later, alongside the other blocksets, by RomLoadBlocksetData
+    auto e = std::make_shared<BlocksetEntry>(this, rom.read_array<uint8_t>(begin, end - begin), name, filename);
     e->SetStartAddress(begin);
     e->SetIndex({ pri, sec });
     m_blocksets_by_name.insert({ name, e });
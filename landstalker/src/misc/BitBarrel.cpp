@@ -7,17 +7,37 @@ namespace Landstalker {
 
 BitBarrel::BitBarrel(const uint8_t* buf)
 : m_start(buf),
+  m_end(nullptr),
+  m_next(buf),
+  m_acc(0),
+  m_count(0),
+  m_padding(0),
   m_val(0),
-  m_pos(8),
-  m_buf(const_cast<uint8_t*>(buf))
+  m_pos(8)
+{
+}
+
+BitBarrel::BitBarrel(const uint8_t* buf, size_t size)
+: m_start(buf),
+  m_end(buf + size),
+  m_next(buf),
+  m_acc(0),
+  m_count(0),
+  m_padding(0),
+  m_val(0),
+  m_pos(8)
 {
 }
 
 BitBarrel::BitBarrel()
 : m_start(0),
+  m_end(0),
+  m_next(0),
+  m_acc(0),
+  m_count(0),
+  m_padding(0),
   m_val(0),
-  m_pos(0),
-  m_buf(NULL)
+  m_pos(0)
 {
 }
 
@@ -84,39 +104,37 @@ T BitBarrel::read() const
     return static_cast<T>(readBits(sizeof(T) * CHAR_BIT));
 }
 
-uint32_t BitBarrel::readBits(size_t numBits) const
+size_t BitBarrel::getBytePosition() const
 {
-    uint32_t retval = 0;
-    for(size_t i = 0; i < numBits; ++i)
-    {
-        retval <<= 1;
-        retval |= static_cast<uint32_t>(getNextBit());
-    }
-    return retval;
+    // Index of the byte holding the next unread bit
+    return getBitPosition() / 8;
 }
 
-bool BitBarrel::getNextBit() const
+size_t BitBarrel::getBitsRemaining() const
 {
-    if(m_pos == 0)
+    if (m_end == nullptr)
     {
-        m_pos = 8;
-        m_buf++;
+        return 0;
     }
-    return (*m_buf & (1 << --m_pos)) ? true : false;
+    const size_t total_bits = (m_end - m_start) * 8;
+    const size_t consumed_bits = getBitPosition();
+    return (consumed_bits < total_bits) ? (total_bits - consumed_bits) : 0;
 }
 
-size_t BitBarrel::getBytePosition() const
+bool BitBarrel::overrun() const
+{
+    // Peeking past the end is harmless; only consuming padding counts
+    return m_end != nullptr && getBitPosition() > static_cast<size_t>(m_end - m_start) * 8;
+}
+
+size_t BitBarrel::getBitPosition() const
 {
-    return m_buf - m_start;
+    return (m_next - m_start) * 8 + m_padding - m_count;
 }
 
 void BitBarrel::advanceNextByte()
 {
-    if(m_pos != 8)
-    {
-        m_pos = 8;
-        m_buf++;
-    }
+    skipBits((8 - getBitPosition() % 8) % 8);
 }
 
 template uint8_t  BitBarrel::read() const;
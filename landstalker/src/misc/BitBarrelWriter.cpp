@@ -1,11 +1,29 @@
 #include <landstalker/misc/BitBarrelWriter.h>
 
 #include <climits>
+#include <algorithm>
+#include <stdexcept>
 
 namespace Landstalker {
 
 BitBarrelWriter::BitBarrelWriter()
-    :m_bitpos(-1)
+    : m_external(false),
+      m_data(nullptr),
+      m_capacity(0),
+      m_acc(0),
+      m_accbits(0),
+      m_flushed(0),
+      m_size(0)
+{}
+
+BitBarrelWriter::BitBarrelWriter(std::span<uint8_t> out)
+    : m_external(true),
+      m_data(out.data()),
+      m_capacity(out.size()),
+      m_acc(0),
+      m_accbits(0),
+      m_flushed(0),
+      m_size(0)
 {}
 
 template <class T>
@@ -22,44 +40,102 @@ void BitBarrelWriter::Write(bool value)
 
 void BitBarrelWriter::WriteBits(uint32_t value, size_t numBits)
 {
-    while (numBits--)
+    if (numBits == 0)
+    {
+        return;
+    }
+    if (m_accbits + numBits > 64)
     {
-        SetNextBit((value & (1 << numBits)) > 0);
+        FlushWholeBytes();
     }
+    const uint64_t bits = static_cast<uint64_t>(value) & ((uint64_t(1) << numBits) - 1);
+    m_acc |= bits << (64 - m_accbits - numBits);
+    m_accbits += numBits;
+    m_size = std::max(m_size, m_flushed + (m_accbits + 7) / 8);
 }
 
 void BitBarrelWriter::AdvanceNextByte()
 {
-    if (m_bitpos != 7)
+    // Starts a new, empty byte. A no-op if we are already at the start of one.
+    const size_t bits = m_flushed * 8 + m_accbits;
+    if (bits % 8 == 0 && m_size == bits / 8 + 1)
     {
-        m_bitpos = 7;
-        m_buffer.push_back(0);
+        return;
     }
+    m_accbits = (m_accbits + 7) & ~size_t(7);
+    m_size = (bits + 7) / 8 + 1;
 }
 
 void BitBarrelWriter::SetNextBit(bool value)
 {
-    if (m_bitpos < 0)
+    WriteBits(value ? 1 : 0, 1);
+}
+
+void BitBarrelWriter::Reserve(size_t bytes)
+{
+    if (!m_external && bytes > m_capacity)
     {
-        AdvanceNextByte();
+        EnsureCapacity(bytes);
+    }
+}
+
+void BitBarrelWriter::Flush() const
+{
+    // Leaves the accumulator untouched so that writing can continue
+    EnsureCapacity(m_size);
+    for (size_t i = m_flushed; i < m_size; ++i)
+    {
+        const size_t shift = (i - m_flushed) * 8;
+        m_data[i] = (shift < 64) ? static_cast<uint8_t>(m_acc >> (56 - shift)) : 0;
     }
-    m_buffer.back() |= static_cast<uint8_t>(value) << m_bitpos;
-    m_bitpos--;
 }
 
 size_t BitBarrelWriter::GetByteCount() const
 {
-    return m_buffer.size();
+    return m_size;
 }
 
-std::vector<uint8_t>::const_iterator BitBarrelWriter::Begin() const
+std::span<const uint8_t> BitBarrelWriter::Data() const
 {
-    return m_buffer.cbegin();
+    Flush();
+    return { m_data, m_size };
 }
 
-std::vector<uint8_t>::const_iterator BitBarrelWriter::End() const
+const uint8_t* BitBarrelWriter::Begin() const
 {
-    return m_buffer.cend();
+    return Data().data();
+}
+
+const uint8_t* BitBarrelWriter::End() const
+{
+    return Begin() + m_size;
+}
+
+void BitBarrelWriter::FlushWholeBytes()
+{
+    const size_t count = m_accbits / 8;
+    EnsureCapacity(m_flushed + count);
+    for (size_t i = 0; i < count; ++i)
+    {
+        m_data[m_flushed++] = static_cast<uint8_t>(m_acc >> 56);
+        m_acc <<= 8;
+    }
+    m_accbits -= count * 8;
+}
+
+void BitBarrelWriter::EnsureCapacity(size_t bytes) const
+{
+    if (bytes <= m_capacity)
+    {
+        return;
+    }
+    if (m_external)
+    {
+        throw std::runtime_error("Output buffer not large enough to hold result.");
+    }
+    m_buffer.resize(std::max(bytes, m_buffer.size() * 2));
+    m_data = m_buffer.data();
+    m_capacity = m_buffer.size();
 }
 
 template void BitBarrelWriter::Write(uint8_t);
@@ -3,6 +3,7 @@
 #include <stdexcept>
 #include <sstream>
 #include <algorithm>
+#include <utility>
 #include <cassert>
 #include <iostream>
 #include <iomanip>
@@ -74,6 +75,271 @@ size_t LZ77::Decode(const uint8_t* inbuf, size_t bufsize, uint8_t* outbuf, size_
     return dsize;
 }
 
+size_t LZ77::Decode(std::span<const uint8_t> in, std::span<uint8_t> out, size_t& esize)
+{
+    const uint8_t* inptr = in.data();
+    const uint8_t* const inend = inptr + in.size();
+    uint8_t* const outbegin = out.data();
+    uint8_t* const outend = outbegin + out.size();
+    uint8_t* outptr = outbegin;
+    uint8_t cmd = 0;
+    int cmd_bits = 0;
+
+    while (true)
+    {
+        if (cmd_bits == 0)
+        {
+            if (inptr == inend)
+            {
+                throw std::runtime_error("Unexpected end of LZ77 input data");
+            }
+            cmd = *inptr++;
+            cmd_bits = 8;
+        }
+        const bool literal = (cmd & 0x80) != 0;
+        cmd <<= 1;
+        --cmd_bits;
+        if (literal)
+        {
+            if (inptr == inend)
+            {
+                throw std::runtime_error("Unexpected end of LZ77 input data");
+            }
+            if (outptr == outend)
+            {
+                throw std::runtime_error("Output buffer not large enough to hold result.");
+            }
+            *outptr++ = *inptr++;
+            continue;
+        }
+        if (inend - inptr < 2)
+        {
+            throw std::runtime_error("Unexpected end of LZ77 input data");
+        }
+        const size_t offset = (inptr[0] & 0xF0) << 4 | inptr[1];
+        size_t length = 18 - (inptr[0] & 0x0F);
+        inptr += 2;
+        if (offset == 0)
+        {
+            break;
+        }
+        if (offset > static_cast<size_t>(outptr - outbegin))
+        {
+            throw std::runtime_error("LZ77 back-reference precedes start of output");
+        }
+        if (length > static_cast<size_t>(outend - outptr))
+        {
+            throw std::runtime_error("Output buffer not large enough to hold result.");
+        }
+        if (offset == 1)
+        {
+            std::memset(outptr, *(outptr - 1), length);
+            outptr += length;
+        }
+        else
+        {
+            // Copy in chunks of at most one offset, so that each chunk's source
+            // and destination never overlap. When offset >= length, this is a
+            // single memcpy.
+            while (length > 0)
+            {
+                const size_t chunk = std::min(offset, length);
+                std::memcpy(outptr, outptr - offset, chunk);
+                outptr += chunk;
+                length -= chunk;
+            }
+        }
+    }
+    esize = inptr - in.data();
+    return outptr - outbegin;
+}
+
+// Writes into out, or, if grow is given, into *grow, which is enlarged as the
+// decoded data needs more room. out must then be a view of *grow.
+template<size_t BIT_DEPTH>
+static size_t DecodeAndUnpackPixels(std::span<const uint8_t> in, std::span<uint8_t> out, size_t& esize, std::vector<uint8_t>* grow = nullptr)
+{
+    constexpr size_t PIXELS_PER_BYTE = 8 / BIT_DEPTH;
+    constexpr uint8_t MASK = static_cast<uint8_t>(0xFF >> (8 - BIT_DEPTH));
+    const uint8_t* inptr = in.data();
+    const uint8_t* const inend = inptr + in.size();
+    uint8_t* outbegin = out.data();
+    uint8_t* outend = outbegin + out.size();
+    uint8_t* outptr = outbegin;
+    uint8_t cmd = 0;
+    int cmd_bits = 0;
+
+    auto make_room = [&](size_t count)
+    {
+        if (count <= static_cast<size_t>(outend - outptr))
+        {
+            return;
+        }
+        if (grow == nullptr)
+        {
+            throw std::runtime_error("Output buffer not large enough to hold result.");
+        }
+        const size_t written = outptr - outbegin;
+        grow->resize(std::max(grow->size() * 2, written + count));
+        outbegin = grow->data();
+        outend = outbegin + grow->size();
+        outptr = outbegin + written;
+    };
+
+    while (true)
+    {
+        if (cmd_bits == 0)
+        {
+            if (inptr == inend)
+            {
+                throw std::runtime_error("Unexpected end of LZ77 input data");
+            }
+            cmd = *inptr++;
+            cmd_bits = 8;
+        }
+        const bool literal = (cmd & 0x80) != 0;
+        cmd <<= 1;
+        --cmd_bits;
+        if (literal)
+        {
+            if (inptr == inend)
+            {
+                throw std::runtime_error("Unexpected end of LZ77 input data");
+            }
+            make_room(PIXELS_PER_BYTE);
+            const uint8_t byte = *inptr++;
+            for (size_t p = PIXELS_PER_BYTE; p > 0; --p)
+            {
+                *outptr++ = (byte >> ((p - 1) * BIT_DEPTH)) & MASK;
+            }
+            continue;
+        }
+        if (inend - inptr < 2)
+        {
+            throw std::runtime_error("Unexpected end of LZ77 input data");
+        }
+        // Offset and length are in packed bytes; scale them to pixels
+        const size_t offset = ((inptr[0] & 0xF0) << 4 | inptr[1]) * PIXELS_PER_BYTE;
+        const size_t length = (18 - (inptr[0] & 0x0F)) * PIXELS_PER_BYTE;
+        inptr += 2;
+        if (offset == 0)
+        {
+            break;
+        }
+        if (offset > static_cast<size_t>(outptr - outbegin))
+        {
+            throw std::runtime_error("LZ77 back-reference precedes start of output");
+        }
+        make_room(length);
+        if (offset >= length)
+        {
+            std::memcpy(outptr, outptr - offset, length);
+        }
+        else
+        {
+            // Overlapping copies repeat the last offset pixels; runs are short
+            // enough that a plain forward copy beats splitting into chunks
+            for (size_t i = 0; i < length; ++i)
+            {
+                outptr[i] = outptr[i - offset];
+            }
+        }
+        outptr += length;
+    }
+    esize = inptr - in.data();
+    return outptr - outbegin;
+}
+
+size_t LZ77::DecodeAndUnpack(std::span<const uint8_t> in, std::span<uint8_t> out, size_t bit_depth, size_t& esize)
+{
+    switch (bit_depth)
+    {
+    case 1:
+        return DecodeAndUnpackPixels<1>(in, out, esize);
+    case 2:
+        return DecodeAndUnpackPixels<2>(in, out, esize);
+    case 4:
+        return DecodeAndUnpackPixels<4>(in, out, esize);
+    case 8:
+        return Decode(in, out, esize);
+    default:
+        throw std::runtime_error("Unsupported bit depth");
+    }
+}
+
+size_t LZ77::DecodeAndUnpackToVector(std::span<const uint8_t> in, std::vector<uint8_t>& out, size_t bit_depth, size_t& esize)
+{
+    if (bit_depth != 1 && bit_depth != 2 && bit_depth != 4 && bit_depth != 8)
+    {
+        throw std::runtime_error("Unsupported bit depth");
+    }
+    // Start from a typical 2:1 ratio, or whatever the vector already holds, so
+    // that redecoding into the same vector rarely has to reallocate
+    out.resize(std::max({out.capacity(), in.size() * 2 * (8 / bit_depth), std::size_t{64}}));
+    size_t count = 0;
+    switch (bit_depth)
+    {
+    case 1:
+        count = DecodeAndUnpackPixels<1>(in, out, esize, &out);
+        break;
+    case 2:
+        count = DecodeAndUnpackPixels<2>(in, out, esize, &out);
+        break;
+    case 4:
+        count = DecodeAndUnpackPixels<4>(in, out, esize, &out);
+        break;
+    case 8:
+        count = DecodeAndUnpackPixels<8>(in, out, esize, &out);
+        break;
+    }
+    out.resize(count);
+    return count;
+}
+
+size_t LZ77::DecodedSize(std::span<const uint8_t> in, size_t& esize)
+{
+    const uint8_t* inptr = in.data();
+    const uint8_t* const inend = inptr + in.size();
+    size_t dsize = 0;
+
+    while (true)
+    {
+        if (inptr == inend)
+        {
+            throw std::runtime_error("Unexpected end of LZ77 input data");
+        }
+        uint8_t cmd = *inptr++;
+        for (int i = 0; i < 8; ++i, cmd <<= 1)
+        {
+            if (cmd & 0x80)
+            {
+                if (inptr == inend)
+                {
+                    throw std::runtime_error("Unexpected end of LZ77 input data");
+                }
+                inptr++;
+                dsize++;
+            }
+            else
+            {
+                if (inend - inptr < 2)
+                {
+                    throw std::runtime_error("Unexpected end of LZ77 input data");
+                }
+                const bool end_marker = ((inptr[0] & 0xF0) | inptr[1]) == 0;
+                const size_t length = 18 - (inptr[0] & 0x0F);
+                inptr += 2;
+                if (end_marker)
+                {
+                    esize = inptr - in.data();
+                    return dsize;
+                }
+                dsize += length;
+            }
+        }
+    }
+}
+
 struct Entry
 {
     enum Type {T_END, T_BYTE, T_RUN} type;
@@ -84,109 +350,214 @@ struct Entry
     {}
 };
 
-static uint8_t find_best_match(const uint8_t* inbuf, size_t bufsize, size_t curpos, uint16_t& offset)
+// Indexes every 3-byte prefix in the input using hash chains, so that candidate
+// matches can be enumerated nearest-first without scanning the whole window.
+// Searches must be performed in increasing order of position.
+class MatchFinder
 {
-    const uint8_t LEN_MAX_LIMIT = 18;
-    const uint8_t LEN_MIN_LIMIT = 3;
-    const uint16_t MAX_OFFSET = 4095;
-    uint8_t best_len = 0;
-    if((inbuf != NULL) && (bufsize > 3) && (curpos > 0))
+public:
+    MatchFinder(const uint8_t* inbuf, size_t bufsize)
+    : m_inbuf(inbuf),
+      m_bufsize(bufsize),
+      m_inserted(0),
+      m_head(HASH_SIZE, -1),
+      m_prev(bufsize, -1)
     {
-        const uint16_t END_SEARCH = (curpos > MAX_OFFSET) ? static_cast<uint16_t>(curpos - MAX_OFFSET) : 0;
-        const uint8_t MAX_LEN = static_cast<uint8_t>(std::min(static_cast<size_t>(LEN_MAX_LIMIT), bufsize - curpos));
-        uint8_t len = 0;
-        if(MAX_LEN < LEN_MAX_LIMIT)
-        {
-            len = 1;
-        }
-        if(MAX_LEN >= LEN_MIN_LIMIT)
+    }
+
+    // Returns the longest match for the data at curpos, and the smallest offset at
+    // which that match can be found. Lengths below LEN_MIN_LIMIT should be ignored.
+    uint8_t FindBestMatch(size_t curpos, uint16_t& offset)
+    {
+        uint8_t best_len = 0;
+        InsertUpTo(curpos);
+        if ((m_bufsize > 3) && (curpos > 0))
         {
-            for(size_t i = curpos; i > END_SEARCH; --i)
+            const uint8_t MAX_LEN = static_cast<uint8_t>(std::min(static_cast<size_t>(LEN_MAX_LIMIT), m_bufsize - curpos));
+            if (MAX_LEN < LEN_MIN_LIMIT)
+            {
+                return 1;
+            }
+            const uint8_t* cur = m_inbuf + curpos;
+            for (int32_t i = m_head[Hash(curpos)]; i >= 0; i = m_prev[i])
             {
-                len = 0;
-                while(inbuf[len + i - 1] == inbuf[curpos + len])
+                if (curpos - i > MAX_OFFSET)
+                {
+                    break;
+                }
+                const uint8_t* cand = m_inbuf + i;
+                if (cand[best_len] != cur[best_len])
+                {
+                    continue;
+                }
+                uint8_t len = 0;
+                while (len < MAX_LEN && cand[len] == cur[len])
                 {
                     len++;
-                    if(len == MAX_LEN)
-                    {
-                        break;
-                    }
                 }
-                if(len > best_len)
+                if (len > best_len)
                 {
                     best_len = len;
-                    offset = static_cast<uint16_t>(curpos - i + 1);
-                    if(best_len == MAX_LEN)
+                    offset = static_cast<uint16_t>(curpos - i);
+                    if (best_len == MAX_LEN)
                     {
                         break;
                     }
                 }
             }
         }
-        else
+        return best_len;
+    }
+
+private:
+    static const uint8_t LEN_MAX_LIMIT = 18;
+    static const uint8_t LEN_MIN_LIMIT = 3;
+    static const size_t MAX_OFFSET = 4095;
+    static const unsigned int HASH_BITS = 15;
+    static const size_t HASH_SIZE = 1 << HASH_BITS;
+
+    uint32_t Hash(size_t pos) const
+    {
+        const uint32_t key = (m_inbuf[pos] << 16) | (m_inbuf[pos + 1] << 8) | m_inbuf[pos + 2];
+        return (key * 2654435761u) >> (32 - HASH_BITS);
+    }
+
+    void InsertUpTo(size_t pos)
+    {
+        const size_t limit = std::min(pos, m_bufsize >= 2 ? m_bufsize - 2 : 0);
+        for (; m_inserted < limit; ++m_inserted)
         {
-            best_len = 1;
+            uint32_t h = Hash(m_inserted);
+            m_prev[m_inserted] = m_head[h];
+            m_head[h] = static_cast<int32_t>(m_inserted);
         }
     }
-    return best_len;
-}
 
-size_t LZ77::Encode(const uint8_t* inbuf, size_t bufsize, uint8_t* outbuf)
+    const uint8_t* m_inbuf;
+    const size_t m_bufsize;
+    size_t m_inserted;
+    std::vector<int32_t> m_head;
+    std::vector<int32_t> m_prev;
+};
+
+// Finds the parse with the lowest cost in bits using dynamic programming.
+// A literal costs 9 bits and a back-reference costs 17 bits.
+static void parse_optimal(const uint8_t* inbuf, size_t bufsize, std::vector<Entry>& entries)
 {
-    size_t esize = 0;
-    std::vector<Entry> entries;
-    BitBarrel bb;
-    
-    if (bufsize > 0)
-    {
-        std::vector<uint32_t> min_cost(bufsize + 1, 0xFFFFFFFF);
-        std::vector<uint8_t> best_len(bufsize + 1, 0);
-        std::vector<uint16_t> best_offset(bufsize + 1, 0);
+    std::vector<uint32_t> min_cost(bufsize + 1, 0xFFFFFFFF);
+    std::vector<uint8_t> best_len(bufsize + 1, 0);
+    std::vector<uint16_t> best_offset(bufsize + 1, 0);
 
-        min_cost[0] = 0;
+    MatchFinder finder(inbuf, bufsize);
 
-        for (size_t i = 0; i < bufsize; ++i)
+    min_cost[0] = 0;
+
+    for (size_t i = 0; i < bufsize; ++i)
+    {
+        if (min_cost[i] + 9 < min_cost[i + 1])
         {
-            if (min_cost[i] + 9 < min_cost[i + 1])
-            {
-                min_cost[i + 1] = min_cost[i] + 9;
-                best_len[i + 1] = 1;
-            }
+            min_cost[i + 1] = min_cost[i] + 9;
+            best_len[i + 1] = 1;
+        }
 
-            uint16_t match_offset = 0;
-            uint8_t match_len = find_best_match(inbuf, bufsize, i, match_offset);
+        uint16_t match_offset = 0;
+        uint8_t match_len = finder.FindBestMatch(i, match_offset);
 
-            for (uint8_t l = 3; l <= match_len; ++l)
+        for (uint8_t l = 3; l <= match_len; ++l)
+        {
+            if (i + l <= bufsize && min_cost[i] + 17 < min_cost[i + l])
             {
-                if (i + l <= bufsize && min_cost[i] + 17 < min_cost[i + l])
-                {
-                    min_cost[i + l] = min_cost[i] + 17;
-                    best_len[i + l] = l;
-                    best_offset[i + l] = match_offset;
-                }
+                min_cost[i + l] = min_cost[i] + 17;
+                best_len[i + l] = l;
+                best_offset[i + l] = match_offset;
             }
         }
+    }
 
-        std::vector<Entry> reverse_entries;
-        size_t i = bufsize;
-        while (i > 0)
+    std::vector<Entry> reverse_entries;
+    size_t i = bufsize;
+    while (i > 0)
+    {
+        uint8_t l = best_len[i];
+        if (l == 1)
         {
-            uint8_t l = best_len[i];
-            if (l == 1)
-            {
-                reverse_entries.push_back(Entry(Entry::T_BYTE, inbuf[i - 1], 0));
-                i -= 1;
-            }
-            else
+            reverse_entries.push_back(Entry(Entry::T_BYTE, inbuf[i - 1], 0));
+            i -= 1;
+        }
+        else
+        {
+            reverse_entries.push_back(Entry(Entry::T_RUN, l, best_offset[i]));
+            i -= l;
+        }
+    }
+
+    for (auto it = reverse_entries.rbegin(); it != reverse_entries.rend(); ++it)
+    {
+        entries.push_back(*it);
+    }
+}
+
+// Takes the longest match at each position. If lazy is set, a match is deferred
+// by one byte whenever the match starting at the next byte is longer.
+static void parse_greedy(const uint8_t* inbuf, size_t bufsize, std::vector<Entry>& entries, bool lazy)
+{
+    MatchFinder finder(inbuf, bufsize);
+    size_t i = 0;
+    uint16_t match_offset = 0;
+    uint8_t match_len = finder.FindBestMatch(0, match_offset);
+
+    while (i < bufsize)
+    {
+        if (match_len >= 3 && lazy && i + 1 < bufsize)
+        {
+            uint16_t next_offset = 0;
+            uint8_t next_len = finder.FindBestMatch(i + 1, next_offset);
+            if (next_len > match_len)
             {
-                reverse_entries.push_back(Entry(Entry::T_RUN, l, best_offset[i]));
-                i -= l;
+                entries.push_back(Entry(Entry::T_BYTE, inbuf[i], 0));
+                i += 1;
+                match_len = next_len;
+                match_offset = next_offset;
+                continue;
             }
         }
+        if (match_len >= 3)
+        {
+            entries.push_back(Entry(Entry::T_RUN, match_len, match_offset));
+            i += match_len;
+        }
+        else
+        {
+            entries.push_back(Entry(Entry::T_BYTE, inbuf[i], 0));
+            i += 1;
+        }
+        if (i < bufsize)
+        {
+            match_len = finder.FindBestMatch(i, match_offset);
+        }
+    }
+}
 
-        for (auto it = reverse_entries.rbegin(); it != reverse_entries.rend(); ++it)
+size_t LZ77::Encode(const uint8_t* inbuf, size_t bufsize, uint8_t* outbuf, Level level)
+{
+    size_t esize = 0;
+    std::vector<Entry> entries;
+    BitBarrel bb;
+    
+    if (bufsize > 0)
+    {
+        switch (level)
         {
-            entries.push_back(*it);
+        case Level::FAST:
+            parse_greedy(inbuf, bufsize, entries, false);
+            break;
+        case Level::LAZY:
+            parse_greedy(inbuf, bufsize, entries, true);
+            break;
+        case Level::OPTIMAL:
+        default:
+            parse_optimal(inbuf, bufsize, entries);
+            break;
         }
     }
     entries.push_back(Entry(Entry::T_END,0,0));
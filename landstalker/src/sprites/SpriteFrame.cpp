@@ -85,7 +85,7 @@ std::vector<uint8_t> SpriteFrame::GetBits()
 	return GetBits(m_compressed);
 }
 
-std::vector<uint8_t> SpriteFrame::GetBits(bool compressed)
+std::vector<uint8_t> SpriteFrame::GetBits(bool compressed, LZ77::Level level)
 {
 	std::vector<uint8_t> bits;
 	std::size_t expected_tiles = 0;
@@ -116,7 +116,7 @@ std::vector<uint8_t> SpriteFrame::GetBits(bool compressed)
 		bits.push_back(word_count & 0xFF);
 		auto tiles = m_sprite_gfx->GetBits();
 		std::vector<uint8_t> buffer(65536);
-		buffer.resize(LZ77::Encode(tiles.data(), word_count*2, buffer.data()));
+		buffer.resize(LZ77::Encode(tiles.data(), word_count*2, buffer.data(), level));
 		bits.insert(bits.end(), buffer.begin(), buffer.end());
 	}
 	else
@@ -262,7 +262,7 @@ std::size_t SpriteFrame::SetBits(const std::vector<uint8_t>& src)
 		else if ((ctrl & 0x02) > 0)
 		{
 			std::size_t elen = 0;
-			std::size_t dlen = LZ77::Decode(&(*it), src.end() - it, &(*dest_it), elen);
+			std::size_t dlen = LZ77::Decode({it, src.end()}, {dest_it, sprite_gfx.end()}, elen);
 			dest_it += dlen;
 #ifndef NDEBUG
 			ss.str(std::string());
@@ -433,7 +433,7 @@ std::pair<int, int> SpriteFrame::GetTilePosition(const Tile& tile) const
 	return std::pair<int, int>(x, y);
 }
 
-std::vector<uint8_t>& SpriteFrame::GetTilePixels(int tile_index)
+TilePixels SpriteFrame::GetTilePixels(int tile_index)
 {
 	return m_sprite_gfx->GetTilePixels(tile_index);
 }
@@ -8,6 +8,7 @@ namespace Landstalker {
 HuffmanTree::HuffmanTree()
 {
 	m_root = new Node();
+	UpdateEncodingTable();
 }
 
 HuffmanTree::HuffmanTree(const CharFrequencies& frequencies)
@@ -39,14 +40,23 @@ size_t HuffmanTree::EncodeTree(std::vector<uint8_t>& tree)
 	return offset;
 }
 
-size_t HuffmanTree::DecodeTree(const uint8_t* tree_data, size_t offset, size_t /*buffer_size*/)
+size_t HuffmanTree::DecodeTree(const uint8_t* tree_data, size_t offset, size_t buffer_size)
 {
+	if (offset > buffer_size)
+	{
+		throw std::runtime_error("Huffman tree offset out of range.");
+	}
 	tree_data += offset;
-	BitBarrel leaves(tree_data);
+	BitBarrel leaves(tree_data, buffer_size - offset);
 	Node* cur = m_root;
 	while (true)
 	{
-		if (leaves.getNextBit() == false) // node
+		const bool is_leaf = leaves.getNextBit();
+		if (leaves.overrun())
+		{
+			throw std::runtime_error("Huffman tree corruption detected.");
+		}
+		if (is_leaf == false) // node
 		{
 			if (cur->left == nullptr)
 			{
@@ -117,7 +127,14 @@ void HuffmanTree::RecalculateTree(const CharFrequencies& frequencies)
 
 uint8_t HuffmanTree::DecodeChar(BitBarrel& bb)
 {
-	Node* cur = m_root;
+	// Resolve the first LOOKUP_BITS bits in one step, then walk any remainder
+	const LookupEntry& entry = m_lookup[bb.peekBits(LOOKUP_BITS)];
+	if (entry.node == nullptr)
+	{
+		throw std::runtime_error("Huffman tree is corrupt.");
+	}
+	bb.skipBits(entry.bits);
+	const Node* cur = entry.node;
 	while (cur->chr == 0xFF)
 	{
 		if (bb.getNextBit() == false)
@@ -150,11 +167,28 @@ bool HuffmanTree::EncodeChar(uint8_t chr, BitBarrelWriter& bb)
 {
 	bool success = false;
 
-	if (m_encoding.find(chr) != m_encoding.end())
+	auto it = m_encoding.find(chr);
+	if (it != m_encoding.end())
 	{
-		for (auto c : m_encoding[chr])
+		const Code& code = it->second;
+		if (code.length <= 64)
 		{
-			bb.WriteBits(c == '1', 1);
+			if (code.length > 32)
+			{
+				bb.WriteBits(static_cast<uint32_t>(code.bits >> 32), code.length - 32);
+				bb.WriteBits(static_cast<uint32_t>(code.bits), 32);
+			}
+			else
+			{
+				bb.WriteBits(static_cast<uint32_t>(code.bits), code.length);
+			}
+		}
+		else
+		{
+			for (auto c : code.str)
+			{
+				bb.WriteBits(c == '1', 1);
+			}
 		}
 		success = true;
 	}
@@ -191,13 +225,22 @@ void HuffmanTree::UpdateEncodingTable()
 {
 	m_encoding.clear();
 	UpdateEncodingTable(m_root, "");
+	UpdateLookupTable();
 }
 
 void HuffmanTree::UpdateEncodingTable(Node* node, std::string encoding)
 {
 	if (node->chr != 0xFF)
 	{
-		m_encoding[node->chr] = encoding;
+		Code code{ encoding, 0, encoding.size() };
+		if (code.length <= 64)
+		{
+			for (auto c : encoding)
+			{
+				code.bits = (code.bits << 1) | (c == '1' ? 1 : 0);
+			}
+		}
+		m_encoding[node->chr] = code;
 	}
 	else
 	{
@@ -212,4 +255,20 @@ void HuffmanTree::UpdateEncodingTable(Node* node, std::string encoding)
 	}
 }
 
+void HuffmanTree::UpdateLookupTable()
+{
+	for (size_t code = 0; code < m_lookup.size(); ++code)
+	{
+		const Node* cur = m_root;
+		uint8_t bits = 0;
+		while (cur != nullptr && cur->chr == 0xFF && bits < LOOKUP_BITS)
+		{
+			const bool bit = (code >> (LOOKUP_BITS - 1 - bits)) & 1;
+			cur = bit ? cur->right : cur->left;
+			++bits;
+		}
+		m_lookup[code] = { cur, bits };
+	}
+}
+
 } // namespace Landstalker
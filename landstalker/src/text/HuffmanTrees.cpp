@@ -72,6 +72,7 @@ std::vector<uint8_t> HuffmanTrees::CompressString(const std::vector<uint8_t>& de
 {
 	uint8_t last = eos_marker;
 	BitBarrelWriter compressed;
+	compressed.Reserve(decompressed.size());
 	for(auto chr : decompressed)
 	{
 		if (m_trees.find(last) == m_trees.end())
@@ -100,7 +101,7 @@ std::vector<uint8_t> HuffmanTrees::DecompressString(const std::vector<uint8_t>&
 {
 	std::vector<uint8_t> decompressed;
 	uint8_t last = eos_marker;
-	BitBarrel bb(compressed.data());
+	BitBarrel bb(compressed.data(), compressed.size());
 	do
 	{
 		if (m_trees.find(last) == m_trees.end())
@@ -111,7 +112,7 @@ std::vector<uint8_t> HuffmanTrees::DecompressString(const std::vector<uint8_t>&
 		}
 		last = m_trees[last]->DecodeChar(bb);
 		decompressed.push_back(last);
-	} while (last != eos_marker && bb.getBytePosition() < compressed.size());
+	} while (last != eos_marker && bb.getBitsRemaining() > 0);
 	return decompressed;
 }
 
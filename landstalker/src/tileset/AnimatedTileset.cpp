@@ -1,5 +1,6 @@
 #include <landstalker/tileset/AnimatedTileset.h>
 #include <yaml-cpp/yaml.h>
+#include <algorithm>
 
 namespace Landstalker {
 
@@ -64,11 +65,44 @@ std::vector<uint8_t> AnimatedTileset::GetTile(const Tile& tile, uint8_t frame) c
 	return Tileset::GetTile(static_cast<uint16_t>(t + f_offset));
 }
 
-std::vector<uint8_t>& AnimatedTileset::GetTilePixels(int tile_index, uint8_t frame)
+TilePixels AnimatedTileset::GetTilePixels(int tile_index, uint8_t frame)
 {
-	auto t = tile_index - GetStartTile().GetIndex();
-	auto f_offset = frame * GetFrameSizeTiles();
-	return Tileset::GetTilePixels(t + f_offset);
+	return Tileset::GetTilePixels(GetFrameTileIndex(tile_index, frame));
+}
+
+std::span<const uint8_t> AnimatedTileset::GetTilePixels(int tile_index, uint8_t frame) const
+{
+	return Tileset::GetTilePixels(GetFrameTileIndex(tile_index, frame));
+}
+
+TileView AnimatedTileset::GetTileView(const Tile& tile, uint8_t frame) const
+{
+	Tile frame_tile(tile);
+	frame_tile.SetIndex(static_cast<uint16_t>(GetFrameTileIndex(tile.GetIndex(), frame)));
+	return Tileset::GetTileView(frame_tile);
+}
+
+bool AnimatedTileset::ContainsTile(const Tile& tile) const
+{
+	const std::size_t start = GetStartTile().GetIndex();
+	return tile.GetIndex() >= start && tile.GetIndex() < start + GetFrameSizeTiles();
+}
+
+bool AnimatedTileset::HasTileChanged(const Tile& tile, uint8_t frame) const
+{
+	if (!ContainsTile(tile) || m_frames < 2)
+	{
+		return false;
+	}
+	const uint8_t previous = static_cast<uint8_t>((frame + m_frames - 1) % m_frames);
+	const auto before = GetTilePixels(tile.GetIndex(), previous);
+	const auto after = GetTilePixels(tile.GetIndex(), frame);
+	return !std::equal(before.begin(), before.end(), after.begin(), after.end());
+}
+
+int AnimatedTileset::GetFrameTileIndex(int tile_index, uint8_t frame) const
+{
+	return tile_index - GetStartTile().GetIndex() + frame * static_cast<int>(GetFrameSizeTiles());
 }
 
 uint16_t AnimatedTileset::GetBaseBytes() const
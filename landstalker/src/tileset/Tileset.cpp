@@ -1,39 +1,24 @@
 #include <landstalker/tileset/Tileset.h>
 #include <algorithm>
+#include <cstring>
 #include <sstream>
 #include <numeric>
 #include <iterator>
+#include <string_view>
+#include <stdexcept>
 #include <landstalker/misc/Utils.h>
 #include <landstalker/misc/LZ77.h>
 #include <landstalker/misc/Literals.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TILESET_USE_SSE2
+#endif
+
 namespace Landstalker {
     
 const std::size_t MAXIMUM_CAPACITY = 0x400;
 
-template<class T>
-void HFlip(std::vector<T>& elems, int width)
-{
-    int height = elems.size() / width;
-    for (int i = 0; i < height; ++i)
-    {
-        auto source_it = elems.begin() + width * i;
-        std::reverse(source_it, source_it + width);
-    }
-}
-
-template<class T>
-void VFlip(std::vector<T>& elems, int width)
-{
-    int height = elems.size() / width;
-    for (int i = 0; i < height / 2; ++i)
-    {
-        auto source_it = elems.begin() + width * i;
-        auto dest_it = elems.end() - width * (i + 1);
-        std::swap_ranges(source_it, source_it + width, dest_it);
-    }
-}
-
 struct BlockDimensions
 {
     int width;
@@ -52,6 +37,117 @@ const std::unordered_map<Tileset::BlockType, BlockDimensions> BLOCK_DIMENSIONS =
     {Tileset::BlockType::BLOCK4X6, {4, 6}}
 };
 
+struct TilePosition
+{
+    int x;
+    int y;
+};
+
+// Position within a block, in tiles, of each tile in the order they are stored
+static std::vector<TilePosition> GetBlockLayout(Tileset::BlockType blocktype)
+{
+    const auto& dims = BLOCK_DIMENSIONS.at(blocktype);
+    std::vector<TilePosition> layout(dims.Area());
+    if (blocktype == Tileset::BlockType::BLOCK4X6)
+    {
+        // 4x6 blocks are a little different - they are stored as two separate blocks - e.g.
+        //
+        //  00  04  08  12
+        //  01  05  09  13
+        //  02  06  10  14
+        //  03  07  11  15
+        //  16  18  20  22
+        //  17  19  21  23
+        const std::array<int, 24> transpose4x6{ 0,4,8,12,1,5,9,13,2,6,10,14,3,7,11,15,16,18,20,22,17,19,21,23 };
+        for (int i = 0; i < dims.Area(); ++i)
+        {
+            layout[transpose4x6[i]] = { i % dims.width, i / dims.width };
+        }
+    }
+    else
+    {
+        // Stored a column at a time, top to bottom
+        for (int i = 0; i < dims.Area(); ++i)
+        {
+            layout[i] = { i / dims.height, i % dims.height };
+        }
+    }
+    return layout;
+}
+
+// Expands packed pixels, most significant first, to one byte per pixel
+static void UnpackPixels(const uint8_t* src, std::size_t size, uint8_t* dst, std::size_t bit_depth)
+{
+    std::size_t i = 0;
+    if (bit_depth == 4)
+    {
+#ifdef TILESET_USE_SSE2
+        const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+        for (; i + 16 <= size; i += 16, dst += 32)
+        {
+            const __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            const __m128i hi = _mm_and_si128(_mm_srli_epi16(in, 4), low_nibbles);
+            const __m128i lo = _mm_and_si128(in, low_nibbles);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst), _mm_unpacklo_epi8(hi, lo));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + 16), _mm_unpackhi_epi8(hi, lo));
+        }
+#endif
+        for (; i < size; ++i)
+        {
+            *dst++ = src[i] >> 4;
+            *dst++ = src[i] & 0x0F;
+        }
+        return;
+    }
+    const std::size_t pixels_per_byte = 8 / bit_depth;
+    const uint8_t mask = static_cast<uint8_t>(0xFF >> (8 - bit_depth));
+    for (; i < size; ++i)
+    {
+        for (std::size_t p = pixels_per_byte; p > 0; --p)
+        {
+            *dst++ = (src[i] >> ((p - 1) * bit_depth)) & mask;
+        }
+    }
+}
+
+// Inverse of UnpackPixels. Writes size bytes; surplus pixel bits are masked off.
+static void PackPixels(const uint8_t* src, std::size_t size, uint8_t* dst, std::size_t bit_depth)
+{
+    std::size_t i = 0;
+    if (bit_depth == 4)
+    {
+#ifdef TILESET_USE_SSE2
+        const __m128i low_nibbles = _mm_set1_epi8(0x0F);
+        const __m128i low_bytes = _mm_set1_epi16(0x00FF);
+        for (; i + 16 <= size; i += 16, src += 32)
+        {
+            // Each 16-bit lane holds a pixel pair, first pixel in the low byte
+            const __m128i a = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)), low_nibbles);
+            const __m128i b = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + 16)), low_nibbles);
+            const __m128i pa = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(a, 4), _mm_srli_epi16(a, 8)), low_bytes);
+            const __m128i pb = _mm_and_si128(_mm_or_si128(_mm_slli_epi16(b, 4), _mm_srli_epi16(b, 8)), low_bytes);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), _mm_packus_epi16(pa, pb));
+        }
+#endif
+        for (; i < size; ++i, src += 2)
+        {
+            dst[i] = static_cast<uint8_t>((src[0] << 4) | (src[1] & 0x0F));
+        }
+        return;
+    }
+    const std::size_t pixels_per_byte = 8 / bit_depth;
+    const uint8_t mask = static_cast<uint8_t>(0xFF >> (8 - bit_depth));
+    for (; i < size; ++i)
+    {
+        uint8_t byte = 0;
+        for (std::size_t p = 0; p < pixels_per_byte; ++p)
+        {
+            byte = static_cast<uint8_t>((byte << bit_depth) | (*src++ & mask));
+        }
+        dst[i] = byte;
+    }
+}
+
 Tileset::Tileset(std::size_t width, std::size_t height, uint8_t bit_depth, Tileset::BlockType blocktype)
     : m_width(width * BLOCK_DIMENSIONS.at(blocktype).width),
       m_height(height * BLOCK_DIMENSIONS.at(blocktype).height),
@@ -64,6 +160,7 @@ Tileset::Tileset(std::size_t width, std::size_t height, uint8_t bit_depth, Tiles
 }
 
 Tileset::Tileset(const std::string& filename, bool compressed, std::size_t width, std::size_t height, uint8_t bit_depth, Tileset::BlockType blocktype)
+    : Tileset(width, height, bit_depth, blocktype)
 {
     Open(filename, compressed, width, height, bit_depth, blocktype);
 }
@@ -89,7 +186,7 @@ bool Tileset::operator==(const Tileset& rhs) const
     return ((this->m_bit_depth == rhs.m_bit_depth) &&
         (this->m_tileheight == rhs.m_tileheight) &&
         (this->m_tilewidth == rhs.m_tilewidth) &&
-        (this->m_tiles == rhs.m_tiles));
+        (this->m_pixels == rhs.m_pixels));
 }
 
 bool Tileset::operator!=(const Tileset& rhs) const
@@ -99,46 +196,28 @@ bool Tileset::operator!=(const Tileset& rhs) const
 
 uint32_t Tileset::SetBits(const std::vector<uint8_t>& src, bool compressed)
 {
+    InvalidateCaches();
     const std::size_t tile_size_bytes = m_width * m_height * m_bit_depth / 8;
-    const std::vector<uint8_t>* input = &src;
     m_compressed = compressed;
     uint32_t ret = src.size();
 
-	std::vector<uint8_t> buffer;
+    // Tiles are packed back to back, so the whole set unpacks as one run.
+    // The final tile is zero-padded if the input is short.
     if (compressed == true)
     {
-		buffer.resize(65536);
-        std::size_t elen, dlen;
-        dlen = LZ77::Decode(src.data(), src.size(), buffer.data(), elen);
-        buffer.resize(dlen);
-        input = &buffer;
+        // Decompress straight into pixel storage in a single pass, without an
+        // intermediate packed buffer or a size probe
+        std::size_t elen;
+        const std::size_t num_pixels = LZ77::DecodeAndUnpackToVector(src, m_pixels, m_bit_depth, elen);
+        const std::size_t num_tiles = (num_pixels + (GetTileArea() - 1)) / GetTileArea();
+        m_pixels.resize(num_tiles * GetTileArea(), 0);
         ret = elen;
     }
-    const std::size_t num_tiles = (input->size() + (tile_size_bytes - 1)) / tile_size_bytes;
-
-    m_tiles.clear();
-    m_tiles.assign(num_tiles, std::vector<uint8_t>(m_width * m_height));
-    std::size_t tc = 0;
-    for (auto& t : m_tiles)
+    else
     {
-        for (std::size_t i = 0; i < tile_size_bytes; ++i)
-        {
-            uint8_t byte = 0;
-            if (i + tc < input->size())
-            {
-                byte = input->at(i + tc);
-            }
-            uint8_t shift = static_cast<uint8_t>(8 - m_bit_depth);
-            uint8_t mask = static_cast<uint8_t>(0xFF << shift);
-            const std::size_t pixels_per_byte = 8 / m_bit_depth;
-            for (std::size_t p = 0; p < pixels_per_byte; ++p)
-            {
-                t[i * pixels_per_byte + p] = (byte & mask) >> shift;
-                mask >>= static_cast<uint8_t>(m_bit_depth);
-                shift -= static_cast<uint8_t>(m_bit_depth);
-            }
-        }
-        tc += tile_size_bytes;
+        const std::size_t num_tiles = (src.size() + (tile_size_bytes - 1)) / tile_size_bytes;
+        m_pixels.assign(num_tiles * GetTileArea(), 0);
+        UnpackPixels(src.data(), src.size(), m_pixels.data(), m_bit_depth);
     }
     TransposeBlock();
     return ret;
@@ -187,75 +266,26 @@ bool Tileset::Open(const std::string& filename, bool compressed, std::size_t wid
     return retval;
 }
 
-std::vector<uint8_t> Tileset::GetBits(bool compressed)
+std::vector<uint8_t> Tileset::GetBits(bool compressed, LZ77::Level level)
 {
     std::vector<uint8_t> bits;
     std::vector<uint8_t> buffer;
-    std::vector<std::vector<uint8_t>> tilebuf;
+    std::vector<uint8_t> tilebuf;
     std::vector<uint8_t>* retval = &bits;
-    const std::vector<std::vector<uint8_t>>& tiles = (m_blocktype != BlockType::NORMAL) ? tilebuf : m_tiles;
 
-    bits.reserve(m_width * m_height * m_tiles.size() * m_bit_depth / 8);
     if (m_blocktype != BlockType::NORMAL)
     {
         // Convert back into tiles and reverse transpose
-        for (const auto& t : m_tiles)
-        {
-            for (int x = 0; x < BLOCK_DIMENSIONS.at(m_blocktype).width; ++x)
-            {
-                for (int y = 0; y < BLOCK_DIMENSIONS.at(m_blocktype).height; ++y)
-                {
-                    tilebuf.insert(tilebuf.end(), std::vector<uint8_t>());
-                    for (std::size_t i = 0; i < m_tileheight; ++i)
-                    {
-                        auto line = t.begin() + i * m_width + x * m_tilewidth + y * m_width * m_tileheight;
-                        tilebuf.back().insert(tilebuf.back().end(), line, line + m_tilewidth);
-                    }
-                }
-            }
-            if (m_blocktype == BlockType::BLOCK4X6)
-            {
-                // Additional processing for block4x6 special case 
-                // Fix tile ordering
-                // Block would be transposed as follows:
-                // 00  06  12  18       00  04  08  12
-                // 01  07  13  19       01  05  09  13
-                // 02  08  14  20  ==>  02  06  10  14
-                // 03  09  15  21       03  07  11  15
-                // 04  10  16  22       16  18  20  22
-                // 05  11  17  23       17  19  21  23
-                auto block_start = tilebuf.end() - BLOCK_DIMENSIONS.at(m_blocktype).Area();
-                auto block_end = tilebuf.end();
-                std::vector<std::vector<uint8_t>> blockbuf(block_start, block_end);
-                std::array<uint8_t, 24> UntransposeLUT{ 0,1,2,3,6,7,8,9,12,13,14,15,18,19,20,21,4,5,10,11,16,17,22,23 };
-                for (std::size_t i = 0; i < blockbuf.size(); ++i)
-                {
-                    block_start[i] = blockbuf[UntransposeLUT[i]];
-                }
-            }
-        }
-    }
-    for (const auto& t : tiles)
-    {
-        // Convert to n-bitdepth
-        uint8_t byte = 0;
-        uint8_t bit = 0;
-        for (const auto& p : t)
-        {
-            byte <<= m_bit_depth;
-            byte |= p & (0xFF >> (8 - m_bit_depth));
-            bit += static_cast<uint8_t>(m_bit_depth);
-            if (bit == 8)
-            {
-                bit = 0;
-                bits.push_back(byte);
-            }
-        }
+        UntransposeBlock(tilebuf);
     }
+    const std::vector<uint8_t>& pixels = (m_blocktype != BlockType::NORMAL) ? tilebuf : m_pixels;
+    // Convert to n-bitdepth
+    bits.resize(pixels.size() * m_bit_depth / 8);
+    PackPixels(pixels.data(), bits.size(), bits.data(), m_bit_depth);
     if (compressed)
     {
         buffer.resize(65536);
-        auto csize = LZ77::Encode(bits.data(), bits.size(), buffer.data());
+        auto csize = LZ77::Encode(bits.data(), bits.size(), buffer.data(), level);
         buffer.resize(csize);
         retval = &buffer;
     }
@@ -278,24 +308,24 @@ bool Tileset::Save(const std::string& filename, bool compressed)
 
 void Tileset::Clear()
 {
-    m_tiles.clear();
+    InvalidateCaches();
+    m_pixels.clear();
 }
 
 void Tileset::Reset(int size)
 {
+    InvalidateCaches();
     if (size != -1)
     {
-        m_tiles.resize(size);
-    }
-    for (auto& elem : m_tiles)
-    {
-        std::fill(elem.begin(), elem.end(), 0_u8);
+        m_pixels.resize(size * GetTileArea());
     }
+    std::fill(m_pixels.begin(), m_pixels.end(), 0_u8);
 }
 
 void Tileset::Resize(int size)
 {
-    m_tiles.resize(size);
+    InvalidateCaches();
+    m_pixels.resize(size * GetTileArea());
 }
 
 std::vector<uint8_t> Tileset::GetTileRGB(const Tile& tile, const Palette& palette) const
@@ -383,6 +413,7 @@ std::vector<uint32_t> Tileset::GetTileBGRA(const Tile& tile, const Palette& pale
 
 void Tileset::SetColourIndicies(const std::vector<uint8_t>& colour_indicies)
 {
+    InvalidateCaches();
 	if (colour_indicies.size() == 0)
 	{
 		m_colour_indicies.clear();
@@ -407,7 +438,7 @@ void Tileset::SetColourIndicies(const std::string& colour_indicies)
     SetColourIndicies(Landstalker::SplitStr<uint8_t>(colour_indicies));
 }
 
-std::vector<uint8_t> Tileset::GetColourIndicies() const
+const std::vector<uint8_t>& Tileset::GetColourIndicies() const
 {
     return m_colour_indicies;
 }
@@ -443,7 +474,8 @@ std::array<bool, 16> Tileset::GetLockedColours() const
 
 std::size_t Tileset::GetTileCount() const
 {
-    return m_tiles.size();
+    const std::size_t area = GetTileArea();
+    return (area == 0) ? 0 : m_pixels.size() / area;
 }
 
 std::size_t Tileset::GetTileSizeBytes() const
@@ -453,7 +485,7 @@ std::size_t Tileset::GetTileSizeBytes() const
 
 std::size_t Tileset::GetTilesetUncompressedSizeBytes() const
 {
-	return m_tiles.size() * GetTileSizeBytes();
+	return GetTileCount() * GetTileSizeBytes();
 }
 
 std::size_t Tileset::GetTileWidth() const
@@ -483,21 +515,21 @@ bool Tileset::GetCompressed() const
 
 void Tileset::DeleteTile(int tile_number)
 {
-    if ((tile_number >= 0) && (tile_number < static_cast<int>(m_tiles.size())))
+    InvalidateCaches();
+    if ((tile_number >= 0) && (tile_number < static_cast<int>(GetTileCount())))
     {
-        m_tiles.erase(m_tiles.begin() + tile_number);
+        auto it = m_pixels.begin() + tile_number * GetTileArea();
+        m_pixels.erase(it, it + GetTileArea());
     }
 }
 
 void Tileset::InsertTilesBefore(int tile_number, int count)
 {
-    if ((tile_number >= 0) && (tile_number <= static_cast<int>(m_tiles.size())) &&
+    InvalidateCaches();
+    if ((tile_number >= 0) && (tile_number <= static_cast<int>(GetTileCount())) &&
         (tile_number + count <= static_cast<int>(MAXIMUM_CAPACITY)))
     {
-        for (int i = 0; i < count; ++i)
-        {
-            m_tiles.insert(m_tiles.begin() + tile_number, std::vector<uint8_t>(m_width * m_height));
-        }
+        m_pixels.insert(m_pixels.begin() + tile_number * GetTileArea(), count * GetTileArea(), 0_u8);
     }
 	else
 	{
@@ -507,29 +539,34 @@ void Tileset::InsertTilesBefore(int tile_number, int count)
 
 void Tileset::DuplicateTile(const Tile& src, const Tile& dst)
 {
-    if ((src.GetIndex() < m_tiles.size()) &&
-        (dst.GetIndex() < m_tiles.size()) &&
+    InvalidateCaches();
+    if ((src.GetIndex() < GetTileCount()) &&
+        (dst.GetIndex() < GetTileCount()) &&
         (src.GetIndex() != dst.GetIndex()))
     {
-        m_tiles[src.GetIndex()] = m_tiles[dst.GetIndex()];
+        auto from = GetTileSpan(dst.GetIndex());
+        std::copy(from.begin(), from.end(), GetTileSpan(src.GetIndex()).begin());
     }
 }
 
 void Tileset::SwapTile(const Tile& lhs, const Tile& rhs)
 {
-    if ((lhs.GetIndex() < m_tiles.size()) &&
-        (rhs.GetIndex() < m_tiles.size()) &&
+    InvalidateCaches();
+    if ((lhs.GetIndex() < GetTileCount()) &&
+        (rhs.GetIndex() < GetTileCount()) &&
         (lhs.GetIndex() != rhs.GetIndex()))
     {
-        std::swap(m_tiles[lhs.GetIndex()], m_tiles[rhs.GetIndex()]);
+        auto l = GetTileSpan(lhs.GetIndex());
+        std::swap_ranges(l.begin(), l.end(), GetTileSpan(rhs.GetIndex()).begin());
     }
 }
 
 void Tileset::SetTile(const Tile& src, const std::vector<uint8_t>& value)
 {
-    if (src.GetIndex() < m_tiles.size())
+    InvalidateCaches();
+    if (src.GetIndex() < GetTileCount())
     {
-        if (value.size() == m_height * m_width)
+        if (value.size() == GetTileArea())
         {
             bool ok = true;
             for (auto p : value)
@@ -542,7 +579,7 @@ void Tileset::SetTile(const Tile& src, const std::vector<uint8_t>& value)
             }
             if (ok)
             {
-                m_tiles[src.GetIndex()] = value;
+                std::copy(value.begin(), value.end(), GetTileSpan(src.GetIndex()).begin());
             }
         }
     }
@@ -554,101 +591,309 @@ void Tileset::TransposeBlock()
     {
         return;
     }
-    const auto& DIMS = BLOCK_DIMENSIONS.at(m_blocktype);
-    std::vector<uint8_t>::const_iterator src_it;
-    if (m_blocktype != BlockType::BLOCK4X6)
+    // Tiles within each block are loaded one after another; lay them out
+    // as a single image
+    const auto layout = GetBlockLayout(m_blocktype);
+    const std::size_t subtile_area = m_tilewidth * m_tileheight;
+    std::vector<uint8_t> block(GetTileArea());
+    for (std::size_t i = 0; i < GetTileCount(); ++i)
     {
-        for (auto& b : m_tiles)
+        auto b = GetTileSpan(static_cast<int>(i));
+        std::copy(b.begin(), b.end(), block.begin());
+        for (std::size_t s = 0; s < layout.size(); ++s)
         {
-            std::vector<uint8_t> t = b;
-            src_it = t.begin();
-            for (int x = 0; x < DIMS.width; ++x)
+            auto src_it = block.cbegin() + s * subtile_area;
+            auto dest_it = b.begin() + layout[s].y * m_tileheight * m_width + layout[s].x * m_tilewidth;
+            for (std::size_t y = 0; y < m_tileheight; ++y)
             {
-                auto dest_it = b.begin();
-                for (std::size_t y = 0; y < m_height; ++y)
-                {
-                    std::copy(src_it, src_it + m_tilewidth, dest_it + x * m_tilewidth);
-                    src_it += m_tilewidth;
-                    dest_it += m_width;
-                }
+                std::copy(src_it, src_it + m_tilewidth, dest_it);
+                src_it += m_tilewidth;
+                dest_it += m_width;
             }
         }
     }
-    else
-    {
-        // 4x6 blocks are a little different - they are stored as two separate blocks - e.g.
-        //
-        //  00  04  08  12
-        //  01  05  09  13
-        //  02  06  10  14
-        //  03  07  11  15
-        //  16  18  20  22
-        //  17  19  21  23
-        //
-        //  Here, we store which tiles need to be copied where, and use this lookup table to do
-        //  the transform.
-        const std::array<int, 24> transpose4x6  { 0,4,8,12,1,5,9,13,2,6,10,14,3,7,11,15,16,18,20,22,17,19,21,23};
+}
 
-        for (auto& b : m_tiles)
+void Tileset::UntransposeBlock(std::vector<uint8_t>& bits) const
+{
+    // Inverse of TransposeBlock: splits each block back into its tiles, in
+    // the order they are stored
+    const auto layout = GetBlockLayout(m_blocktype);
+    bits.resize(m_pixels.size());
+    auto dest_it = bits.begin();
+    for (std::size_t i = 0; i < GetTileCount(); ++i)
+    {
+        const auto b = GetTilePixels(static_cast<int>(i));
+        for (const auto& pos : layout)
         {
-            std::vector<std::vector<uint8_t>> tilebuf;
-            src_it = b.begin();
-            for (int i = 0; i < DIMS.Area(); ++i)
+            auto src_it = b.begin() + pos.y * m_tileheight * m_width + pos.x * m_tilewidth;
+            for (std::size_t y = 0; y < m_tileheight; ++y)
             {
-                tilebuf.push_back(std::vector<uint8_t>(src_it, src_it + m_tileheight * m_tilewidth));
-                src_it += m_tileheight * m_tilewidth;
-            }
-            for (std::size_t i = 0; i < tilebuf.size(); ++i)
-            {
-                src_it = tilebuf[transpose4x6[i]].begin();
-                auto dest_it = b.begin() + (i % DIMS.width) * m_tilewidth + (i / DIMS.width) * m_width * m_tileheight;
-                for (std::size_t y = 0; y < m_tileheight; ++y)
-                {
-                    std::copy(src_it, src_it + m_tilewidth, dest_it + y * m_width);
-                    src_it += m_tilewidth;
-                }
+                dest_it = std::copy(src_it, src_it + m_tilewidth, dest_it);
+                src_it += m_width;
             }
         }
     }
 }
 
-void Tileset::UntransposeBlock(std::vector<uint8_t>& /*bits*/)
+std::vector<uint8_t> Tileset::GetTile(const Tile& tile) const
 {
-    // const std::array<int, 24> untranspose4x6{ 0,4,8,12,1,5,9,13,2,6,10,14,3,7,11,15,16,20,17,21,18,22,19,23};
+    const TileView view = GetTileView(tile);
+    std::vector<uint8_t> ret;
+    ret.reserve(GetTileArea());
+    for (std::size_t y = 0; y < view.GetHeight(); ++y)
+    {
+        const auto row = view.GetSourceRow(y);
+        if (view.IsHFlipped())
+        {
+            ret.insert(ret.end(), row.rbegin(), row.rend());
+        }
+        else
+        {
+            ret.insert(ret.end(), row.begin(), row.end());
+        }
+    }
+    return ret;
 }
 
-std::vector<uint8_t> Tileset::GetTile(const Tile& tile) const
+TileView Tileset::GetTileView(const Tile& tile) const
 {
     std::size_t idx = tile.GetIndex();
-    if (idx >= m_tiles.size())
+    if (idx >= GetTileCount())
     {
         std::ostringstream ss;
         ss << "Attempt to obtain out-of-range tile " << idx;
         Debug(ss.str());
         idx = 0;
     }
-    std::vector<uint8_t> ret(m_tiles[idx]);
-    if (tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_VFLIP))
+    return TileView(GetTilePixels(static_cast<int>(idx)), m_width,
+        tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_HFLIP),
+        tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_VFLIP));
+}
+
+TilePixels Tileset::GetTilePixels(int tile_index)
+{
+    return GetTileSpan(tile_index);
+}
+
+std::span<uint8_t> Tileset::GetTileSpan(int tile_index)
+{
+    CheckTileIndex(tile_index);
+    // The caller may write through the span
+    InvalidateCaches();
+    return std::span<uint8_t>(m_pixels).subspan(tile_index * GetTileArea(), GetTileArea());
+}
+
+std::span<const uint8_t> Tileset::GetTilePixels(int tile_index) const
+{
+    CheckTileIndex(tile_index);
+    return std::span<const uint8_t>(m_pixels).subspan(tile_index * GetTileArea(), GetTileArea());
+}
+
+std::span<const uint8_t> Tileset::GetPixels() const
+{
+    return m_pixels;
+}
+
+std::size_t Tileset::GetTileArea() const
+{
+    return m_width * m_height;
+}
+
+static std::size_t HashPixels(std::span<const uint8_t> pixels)
+{
+    return std::hash<std::string_view>{}(std::string_view(reinterpret_cast<const char*>(pixels.data()), pixels.size()));
+}
+
+std::optional<Tile> Tileset::FindTile(std::span<const uint8_t> pixels) const
+{
+    if (pixels.size() != GetTileArea() || pixels.empty())
+    {
+        return std::nullopt;
+    }
+    PrepareTileIndex();
+    // Tiles are usually 8x8, so keep the scratch copy off the heap for those
+    std::array<uint8_t, 64> small;
+    std::vector<uint8_t> large;
+    if (pixels.size() > small.size())
     {
-        VFlip(ret, m_width);
+        large.resize(pixels.size());
     }
-    if (tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_HFLIP))
+    const std::span<uint8_t> flipped = large.empty() ? std::span<uint8_t>(small).first(pixels.size()) : std::span<uint8_t>(large);
+    for (int flip = 0; flip < 4; ++flip)
     {
-        HFlip(ret, m_width);
+        // Flips are their own inverse, so if flipping the query gives a stored
+        // tile, drawing that tile with the same flip gives the query
+        const TileView view(pixels, m_width, (flip & 1) != 0, (flip & 2) != 0);
+        for (std::size_t y = 0; y < view.GetHeight(); ++y)
+        {
+            for (std::size_t x = 0; x < m_width; ++x)
+            {
+                flipped[y * m_width + x] = view(x, y);
+            }
+        }
+        std::optional<std::size_t> found;
+        const auto range = m_tile_index.tiles.equal_range(HashPixels(flipped));
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            const auto candidate = GetTilePixels(static_cast<int>(it->second));
+            if ((!found || it->second < *found) && std::equal(candidate.begin(), candidate.end(), flipped.begin()))
+            {
+                found = it->second;
+            }
+        }
+        if (found)
+        {
+            Tile tile(static_cast<uint16_t>(*found));
+            if (view.IsHFlipped())
+            {
+                tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+            }
+            if (view.IsVFlipped())
+            {
+                tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+            }
+            return tile;
+        }
+    }
+    return std::nullopt;
+}
+
+std::vector<Tile> Tileset::ImportTiles(std::span<const uint8_t> pixels)
+{
+    const std::size_t area = GetTileArea();
+    if (area == 0 || pixels.size() % area != 0)
+    {
+        throw std::runtime_error("Imported pixel data is not a whole number of tiles");
+    }
+    if (std::any_of(pixels.begin(), pixels.end(), [this](uint8_t p) { return p >= (1 << m_bit_depth); }))
+    {
+        throw std::runtime_error("Imported pixel data exceeds the tileset bit depth");
+    }
+    std::vector<Tile> tiles;
+    tiles.reserve(pixels.size() / area);
+    for (std::size_t offset = 0; offset < pixels.size(); offset += area)
+    {
+        const auto tile_pixels = pixels.subspan(offset, area);
+        const auto existing = FindTile(tile_pixels);
+        if (existing)
+        {
+            tiles.push_back(*existing);
+            continue;
+        }
+        const std::size_t index = GetTileCount();
+        if (index >= MAXIMUM_CAPACITY)
+        {
+            throw std::out_of_range("Tileset is full");
+        }
+        // Appending leaves every existing index entry valid, so index the new
+        // tile rather than rebuilding. The render cache has no room for it.
+        m_pixels.insert(m_pixels.end(), tile_pixels.begin(), tile_pixels.end());
+        m_tile_index.tiles.emplace(HashPixels(tile_pixels), index);
+        m_render_cache.valid = false;
+        tiles.push_back(Tile(static_cast<uint16_t>(index)));
+    }
+    return tiles;
+}
+
+void Tileset::MarkTilesDirty()
+{
+    InvalidateCaches();
+}
+
+void Tileset::InvalidateCaches()
+{
+    m_tile_index.valid = false;
+    m_render_cache.valid = false;
+}
+
+void Tileset::PrepareTileIndex() const
+{
+    if (!m_tile_index.valid.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> guard(m_tile_index.lock);
+        if (!m_tile_index.valid.load(std::memory_order_relaxed))
+        {
+            RebuildTileIndex();
+            m_tile_index.valid.store(true, std::memory_order_release);
+        }
+    }
+}
+
+void Tileset::RebuildTileIndex() const
+{
+    m_tile_index.tiles.clear();
+    m_tile_index.tiles.reserve(GetTileCount());
+    for (std::size_t i = 0; i < GetTileCount(); ++i)
+    {
+        m_tile_index.tiles.emplace(HashPixels(GetTilePixels(static_cast<int>(i))), i);
+    }
+}
+
+std::span<const uint64_t> Tileset::GetRenderedTile(const Tile& tile) const
+{
+    if (m_width != 8 || GetTileCount() == 0)
+    {
+        return {};
+    }
+    PrepareRenderCache();
+    // Not logged here, as this runs on every drawing thread
+    const std::size_t idx = tile.GetIndex() < GetTileCount() ? tile.GetIndex() : 0;
+    const std::size_t flips = (tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_HFLIP) ? 1 : 0) |
+                              (tile.Attributes().getAttribute(TileAttributes::Attribute::ATTR_VFLIP) ? 2 : 0);
+    return std::span<const uint64_t>(m_render_cache.tiles).subspan((idx * 4 + flips) * m_height, m_height);
+}
+
+void Tileset::PrepareRenderCache() const
+{
+    if (!m_render_cache.valid.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> guard(m_render_cache.lock);
+        if (!m_render_cache.valid.load(std::memory_order_relaxed))
+        {
+            RebuildRenderCache();
+            m_render_cache.valid.store(true, std::memory_order_release);
+        }
+    }
+}
+
+void Tileset::RebuildRenderCache() const
+{
+    std::array<uint8_t, 256> cmap;
+    std::iota(cmap.begin(), cmap.end(), 0_u8);
+    std::copy_n(m_colour_indicies.cbegin(), std::min(m_colour_indicies.size(), cmap.size()), cmap.begin());
+
+    m_render_cache.tiles.assign(m_width == 8 ? GetTileCount() * 4 * m_height : 0, 0);
+    auto dest = m_render_cache.tiles.begin();
+    for (std::size_t i = 0; i < m_render_cache.tiles.size() / (4 * m_height); ++i)
+    {
+        const TileView plain(GetTilePixels(static_cast<int>(i)), m_width, false, false);
+        for (std::size_t flips = 0; flips < 4; ++flips)
+        {
+            const bool hflip = (flips & 1) != 0;
+            const bool vflip = (flips & 2) != 0;
+            for (std::size_t y = 0; y < m_height; ++y)
+            {
+                std::array<uint8_t, 8> row;
+                for (std::size_t x = 0; x < row.size(); ++x)
+                {
+                    row[x] = cmap[plain(hflip ? 7 - x : x, vflip ? m_height - 1 - y : y)];
+                }
+                std::memcpy(&*dest++, row.data(), row.size());
+            }
+        }
     }
-    return ret;
 }
 
-std::vector<uint8_t>& Tileset::GetTilePixels(int tile_index)
+void Tileset::CheckTileIndex(int tile_index) const
 {
-    if ((tile_index < 0) || (tile_index >= static_cast<int>(m_tiles.size())))
+    if ((tile_index < 0) || (tile_index >= static_cast<int>(GetTileCount())))
     {
         std::ostringstream ss;
         ss << "Attempt to obtain out-of-range tile " << tile_index;
         Debug(ss.str());
         throw(std::runtime_error(ss.str()));
     }
-    return m_tiles[tile_index];
 }
 
 } // namespace Landstalker
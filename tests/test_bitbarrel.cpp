@@ -0,0 +1,99 @@
+#include <gtest/gtest.h>
+#include <landstalker/misc/BitBarrel.h>
+#include <vector>
+#include <cstdint>
+
+using namespace Landstalker;
+
+TEST(BitBarrelTest, BoundedReadsMsbFirst) {
+    const std::vector<uint8_t> buf = {0xA5, 0x3C};
+    BitBarrel bb(buf.data(), buf.size());
+
+    EXPECT_EQ(bb.getBitsRemaining(), 16);
+    EXPECT_EQ(bb.readBits(4), 0xAu);
+    EXPECT_EQ(bb.getNextBit(), false);
+    EXPECT_EQ(bb.getNextBit(), true);
+    EXPECT_EQ(bb.readBits(2), 0x1u);
+    EXPECT_EQ(bb.getBitsRemaining(), 8);
+    EXPECT_EQ(bb.readBits(8), 0x3Cu);
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_FALSE(bb.overrun());
+}
+
+TEST(BitBarrelTest, WideReadsSpanRefills) {
+    const std::vector<uint8_t> buf = {0x12, 0x34, 0x56, 0x78, 0x9A, 0xBC, 0xDE, 0xF0, 0x11};
+    BitBarrel bb(buf.data(), buf.size());
+
+    EXPECT_EQ(bb.readBits(4), 0x1u);
+    EXPECT_EQ(bb.readBits(32), 0x23456789u);
+    EXPECT_EQ(bb.readBits(32), 0xABCDEF01u);
+    EXPECT_EQ(bb.readBits(4), 0x1u);
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_FALSE(bb.overrun());
+}
+
+TEST(BitBarrelTest, PeekPastEndIsNotAnOverrun) {
+    const std::vector<uint8_t> buf = {0xFF, 0xF0};
+    BitBarrel bb(buf.data(), buf.size());
+
+    bb.skipBits(8);
+    EXPECT_EQ(bb.peekBits(16), 0xF000u);
+    EXPECT_EQ(bb.peekBits(32), 0xF0000000u);
+    EXPECT_FALSE(bb.overrun());
+    EXPECT_EQ(bb.getBytePosition(), 1);
+    EXPECT_EQ(bb.getBitsRemaining(), 8);
+
+    EXPECT_EQ(bb.readBits(8), 0xF0u);
+    EXPECT_FALSE(bb.overrun());
+}
+
+TEST(BitBarrelTest, ReadingPastEndYieldsZerosAndSetsOverrun) {
+    const std::vector<uint8_t> buf = {0xFF};
+    BitBarrel bb(buf.data(), buf.size());
+
+    EXPECT_EQ(bb.readBits(4), 0xFu);
+    EXPECT_EQ(bb.readBits(8), 0xF0u);
+    EXPECT_TRUE(bb.overrun());
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_EQ(bb.readBits(16), 0u);
+    EXPECT_TRUE(bb.overrun());
+    EXPECT_EQ(bb.getBytePosition(), 3);
+}
+
+TEST(BitBarrelTest, EmptyBufferOverrunsOnFirstRead) {
+    const uint8_t dummy = 0;
+    BitBarrel bb(&dummy, 0);
+
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_EQ(bb.peekBits(8), 0u);
+    EXPECT_FALSE(bb.overrun());
+    EXPECT_FALSE(bb.getNextBit());
+    EXPECT_TRUE(bb.overrun());
+}
+
+TEST(BitBarrelTest, BytePositionAtByteBoundaries) {
+    const std::vector<uint8_t> buf(4, 0x55);
+    for (size_t bits = 0; bits <= 32; ++bits) {
+        BitBarrel bb(buf.data(), buf.size());
+        bb.skipBits(bits);
+        EXPECT_EQ(bb.getBytePosition(), bits / 8) << "after " << bits << " bits";
+        EXPECT_EQ(bb.getBitsRemaining(), 32 - bits) << "after " << bits << " bits";
+
+        // Aligning moves to the start of the next byte, unless already on one
+        bb.advanceNextByte();
+        EXPECT_EQ(bb.getBytePosition(), (bits + 7) / 8) << "after " << bits << " bits";
+        EXPECT_FALSE(bb.overrun()) << "after " << bits << " bits";
+    }
+}
+
+TEST(BitBarrelTest, UnboundedReaderHasNoEnd) {
+    const std::vector<uint8_t> buf = {0x80, 0x01, 0x00};
+    BitBarrel bb(buf.data());
+
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_TRUE(bb.getNextBit());
+    EXPECT_EQ(bb.readBits(15), 0x0001u);
+    EXPECT_EQ(bb.getBytePosition(), 2);
+    EXPECT_EQ(bb.getBitsRemaining(), 0);
+    EXPECT_FALSE(bb.overrun());
+}
@@ -0,0 +1,158 @@
+#include <gtest/gtest.h>
+#include <landstalker/blockset/BlocksetCmp.h>
+#include <landstalker/main/DataTypes.h>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <utility>
+
+using namespace Landstalker;
+
+class BlocksetTest : public ::testing::Test {
+protected:
+    void PrintCompressionRatio(const std::string& test_name, size_t original_size, size_t compressed_size) {
+        double ratio = (original_size == 0) ? 0.0 : (100.0 * compressed_size) / original_size;
+        std::cout << "[ RATIO    ] " << test_name << ": "
+                  << compressed_size << " / " << original_size << " bytes ("
+                  << std::fixed << std::setprecision(2) << ratio << "%)" << std::endl;
+    }
+
+    // Blocks drawn from a small pool of tiles, with some pairs of
+    // consecutive tiles so that both queue hits and implied tiles occur
+    Blockset MakeBlockset(size_t count) const {
+        Blockset blocks;
+        uint32_t seed = 12345;
+        auto next = [&seed]() {
+            seed = seed * 1103515245 + 12345;
+            return (seed >> 16) & 0x7FFF;
+        };
+        for (size_t i = 0; i < count; ++i) {
+            std::vector<Tile> tiles;
+            for (size_t t = 0; t < 4; ++t) {
+                uint16_t index = static_cast<uint16_t>(0x100 + next() % 40);
+                if (t % 2 == 1 && next() % 2 == 0) {
+                    index = tiles.back().GetIndex() + 1;
+                }
+                uint16_t attrs = (next() % 5 == 0) ? 0x8000 : 0;
+                tiles.push_back(Tile(static_cast<uint16_t>(attrs | index)));
+            }
+            blocks.push_back(MapBlock(tiles.begin(), tiles.end()));
+        }
+        return blocks;
+    }
+
+    void ExpectEqual(const Blockset& lhs, const Blockset& rhs) const {
+        ASSERT_EQ(lhs.size(), rhs.size());
+        for (size_t i = 0; i < lhs.size(); ++i) {
+            for (size_t t = 0; t < MapBlock::GetBlockSize(); ++t) {
+                EXPECT_EQ(lhs[i].GetTile(t), rhs[i].GetTile(t));
+            }
+        }
+    }
+};
+
+TEST_F(BlocksetTest, RoundTrip) {
+    Blockset blocks = MakeBlockset(500);
+    std::vector<uint8_t> buffer(65536, 0);
+
+    uint16_t compressed_size = BlocksetCmp::Encode(blocks, buffer.data(), buffer.size());
+    PrintCompressionRatio("RoundTrip", blocks.size() * 8, compressed_size);
+
+    Blockset decoded;
+    EXPECT_EQ(BlocksetCmp::Decode(buffer.data(), compressed_size, decoded), compressed_size);
+    ExpectEqual(blocks, decoded);
+}
+
+TEST_F(BlocksetTest, EncodeMatchesReference) {
+    Blockset blocks = MakeBlockset(500);
+    std::vector<uint8_t> buffer(65536, 0);
+    uint16_t compressed_size = BlocksetCmp::Encode(blocks, buffer.data(), buffer.size());
+
+    // Length and FNV-1a hash recorded from the original deque-based encoder
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < compressed_size; ++i) {
+        hash = (hash ^ buffer[i]) * 16777619u;
+    }
+    EXPECT_EQ(compressed_size, 2074);
+    EXPECT_EQ(hash, 0xA75EA276u);
+}
+
+TEST_F(BlocksetTest, OptimisedCompressionNoLargerThanNormal) {
+    Blockset blocks = MakeBlockset(500);
+    std::vector<uint8_t> normal(65536, 0);
+    std::vector<uint8_t> optimised(65536, 0);
+
+    uint16_t normal_size = BlocksetCmp::Encode(blocks, normal.data(), normal.size());
+    uint16_t optimised_size = BlocksetCmp::Encode(blocks, optimised.data(), optimised.size(),
+        BlocksetCmp::Compression::OPTIMISED);
+    PrintCompressionRatio("OptimisedCompression (normal)", blocks.size() * 8, normal_size);
+    PrintCompressionRatio("OptimisedCompression (optimised)", blocks.size() * 8, optimised_size);
+    EXPECT_LE(optimised_size, normal_size);
+
+    Blockset decoded;
+    EXPECT_EQ(BlocksetCmp::Decode(optimised.data(), optimised_size, decoded), optimised_size);
+    ExpectEqual(blocks, decoded);
+}
+
+TEST_F(BlocksetTest, DecodeRejectsTruncatedInput) {
+    Blockset blocks = MakeBlockset(100);
+    std::vector<uint8_t> buffer(65536, 0);
+    uint16_t compressed_size = BlocksetCmp::Encode(blocks, buffer.data(), buffer.size());
+
+    Blockset decoded;
+    EXPECT_THROW(BlocksetCmp::Decode(buffer.data(), compressed_size / 2, decoded), std::runtime_error);
+}
+
+TEST_F(BlocksetTest, CombinedBlocksetFollowsEdits) {
+    auto make_entry = [this](size_t count, const std::string& name) {
+        std::vector<uint8_t> buffer(65536, 0);
+        buffer.resize(BlocksetCmp::Encode(MakeBlockset(count), buffer.data(), buffer.size()));
+        return BlocksetEntry::Create(nullptr, buffer, name, name + ".cmp");
+    };
+    auto pri = make_entry(40, "pri");
+    auto sec = make_entry(60, "sec");
+    CombinedBlocksetCache cache;
+
+    auto combined = cache.Get(pri, sec);
+    ASSERT_EQ(combined->size(), 100);
+    EXPECT_EQ(cache.Get(pri, sec), combined);
+
+    // Reading doesn't count as an edit, through either accessor
+    EXPECT_EQ(std::as_const(*pri).GetData()->size(), 40);
+    EXPECT_EQ(cache.Get(pri, sec), combined);
+    EXPECT_EQ(pri->GetData()->size(), 40);
+    EXPECT_EQ(sec->GetData()->at(5), combined->at(45));
+    EXPECT_EQ(cache.Get(pri, sec), combined);
+
+    // Edit the secondary blockset in place, as an editor would
+    const Tile edited(0x0123);
+    ASSERT_NE(combined->at(45).GetTile(0), edited);
+    sec->GetData()->at(5).SetTile(0, edited);
+    auto updated = cache.Get(pri, sec);
+    EXPECT_NE(updated, combined);
+    EXPECT_EQ(updated->at(45).GetTile(0), edited);
+    ExpectEqual(std::vector(updated->cbegin(), updated->cbegin() + 40), *std::as_const(*pri).GetData());
+
+    // Edits through a kept pointer are seen whether or not they are marked
+    auto held = sec->GetData();
+    EXPECT_EQ(cache.Get(pri, sec)->at(45).GetTile(0), edited);
+    held->at(5).SetTile(1, edited);
+    EXPECT_EQ(cache.Get(pri, sec)->at(45).GetTile(1), edited);
+    held->at(5).SetTile(2, edited);
+    sec->MarkDataChanged();
+    EXPECT_EQ(cache.Get(pri, sec)->at(45).GetTile(2), edited);
+    // The copy handed out earlier is a snapshot
+    EXPECT_NE(combined->at(45).GetTile(0), edited);
+
+    // Abandoning the edit also counts as a change
+    sec->AbandonChanges();
+    EXPECT_EQ(cache.Get(pri, sec)->at(45), combined->at(45));
+
+    // The cache doesn't keep entries alive
+    std::weak_ptr<BlocksetEntry> weak_sec = sec;
+    sec.reset();
+    EXPECT_TRUE(weak_sec.expired());
+    sec = make_entry(60, "sec");
+    EXPECT_EQ(cache.Get(pri, sec)->size(), 100);
+}
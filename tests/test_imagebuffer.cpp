@@ -0,0 +1,277 @@
+#include <gtest/gtest.h>
+#include <landstalker/main/ImageBuffer.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include <span>
+#include <stdexcept>
+#include <algorithm>
+
+using namespace Landstalker;
+
+class ImageBufferTest : public ::testing::Test {
+protected:
+    uint32_t Next() {
+        seed = seed * 1103515245 + 12345;
+        return seed >> 16;
+    }
+
+    std::shared_ptr<Tileset> MakeTileset(size_t count) {
+        std::vector<uint8_t> bytes(count * 32);
+        for (auto& b : bytes) {
+            // Plenty of transparent pixels, so draw order matters
+            b = static_cast<uint8_t>(Next() & 0x3C);
+        }
+        return std::make_shared<Tileset>(bytes);
+    }
+
+    Tile RandomTile(size_t count) {
+        Tile tile(static_cast<uint16_t>(Next()));
+        tile.SetIndex(static_cast<uint16_t>(Next() % count));
+        return tile;
+    }
+
+    std::vector<std::shared_ptr<Palette>> MakePalettes() const {
+        std::vector<std::shared_ptr<Palette>> pals;
+        for (int p = 0; p < 4; ++p) {
+            std::vector<Palette::Colour> cols;
+            for (int i = 0; i < 16; ++i) {
+                cols.emplace_back(static_cast<uint8_t>(p * 64 + i * 4), static_cast<uint8_t>(255 - i * 16), static_cast<uint8_t>(p * 80));
+            }
+            pals.push_back(std::make_shared<Palette>("test", cols, Palette::Type::FULL));
+        }
+        return pals;
+    }
+
+    void ExpectSameImage(const ImageBuffer& lhs, const ImageBuffer& rhs) {
+        const auto pals = MakePalettes();
+        EXPECT_EQ(lhs.GetRGB(pals), rhs.GetRGB(pals));
+        EXPECT_EQ(lhs.GetAlpha(pals, 0x80, 0xFF), rhs.GetAlpha(pals, 0x80, 0xFF));
+    }
+
+    uint32_t seed = 23;
+};
+
+TEST_F(ImageBufferTest, BandedRoomRenderMatchesSerial) {
+    auto tileset = MakeTileset(200);
+    auto blockset = std::make_shared<std::vector<MapBlock>>(150);
+    for (auto& block : *blockset) {
+        for (size_t i = 0; i < 4; ++i) {
+            block.SetTile(i, RandomTile(tileset->GetTileCount()));
+        }
+    }
+    auto map = std::make_shared<Tilemap3D>();
+    map->Resize(37, 29);
+    map->ResizeHeightmap(20, 20);
+    for (int i = 0; i < map->GetSize(); ++i) {
+        map->SetBlock(static_cast<uint16_t>(Next() % 150), i, Tilemap3D::Layer::BG);
+        map->SetBlock(static_cast<uint16_t>(Next() % 150), i, Tilemap3D::Layer::FG);
+    }
+    std::vector<TileSwap> swaps = {
+        TileSwap(0, {3, 4, 10, 8, 5, 4}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::FLOOR),
+        TileSwap(0, {8, 2, 14, 12, 3, 6}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::WALL_NW)
+    };
+    
+    auto render = [&](size_t workers) {
+        ImageBuffer buf(map->GetPixelWidth(), map->GetPixelHeight());
+        buf.SetWorkerCount(workers);
+        buf.Insert3DMapLayer(0, 0, 0, Tilemap3D::Layer::BG, map, tileset, blockset, true, swaps);
+        buf.Insert3DMapLayer(0, 0, 1, Tilemap3D::Layer::FG, map, tileset, blockset, true, swaps, std::nullopt,
+            ImageBuffer::BlockMode::NO_PRIORITY_ONLY);
+        buf.Insert3DMapLayer(0, 0, 2, Tilemap3D::Layer::FG, map, tileset, blockset, true, swaps, std::nullopt,
+            ImageBuffer::BlockMode::PRIORITY_ONLY);
+        return buf;
+    };
+    const auto serial = render(1);
+    for (size_t workers : {2, 3, 5, 8}) {
+        SCOPED_TRACE(workers);
+        ExpectSameImage(serial, render(workers));
+    }
+}
+
+TEST_F(ImageBufferTest, BandedMapRenderMatchesSerial) {
+    auto tileset = MakeTileset(300);
+    Tilemap2D map(50, 41);
+    for (size_t y = 0; y < map.GetHeight(); ++y) {
+        for (size_t x = 0; x < map.GetWidth(); ++x) {
+            map.SetTile(RandomTile(tileset->GetTileCount()), x, y);
+        }
+    }
+    
+    // Offset by a few rows so tiles straddle the band edges
+    auto render = [&](size_t workers) {
+        ImageBuffer buf(map.GetWidth() * 8 + 16, map.GetHeight() * 8 + 16);
+        buf.SetWorkerCount(workers);
+        buf.InsertMap(3, 5, 1, map, *tileset);
+        buf.InsertMap(11, 2, 2, map, *tileset);
+        return buf;
+    };
+    const auto serial = render(1);
+    for (size_t workers : {2, 4, 7}) {
+        SCOPED_TRACE(workers);
+        ExpectSameImage(serial, render(workers));
+    }
+}
+
+TEST_F(ImageBufferTest, WideTilesMatchReferenceRender) {
+    // 16x16 tiles have no render cache, so these go through the row blitters
+    const size_t tile_size = 16;
+    std::vector<uint8_t> bytes(3 * tile_size * tile_size / 2);
+    for (auto& b : bytes) {
+        b = static_cast<uint8_t>(Next() & 0x73);
+    }
+    Tileset tileset(bytes, false, tile_size, tile_size);
+    ASSERT_TRUE(tileset.GetRenderedTile(Tile(0)).empty());
+    const std::vector<uint8_t> remap = {0, 5, 9, 3, 7, 2, 15, 1, 8, 4, 6, 10, 12, 11, 14, 13};
+    const auto pals = MakePalettes();
+    const uint8_t low_pri = 0x80, high_pri = 0xFF;
+    const uint8_t palette_index = 2;
+
+    for (bool use_remap : {false, true}) {
+        tileset.SetColourIndicies(use_remap ? remap : std::vector<uint8_t>());
+        for (bool use_alpha : {false, true}) {
+            for (uint16_t flags = 0; flags < 8; ++flags) {
+                Tile tile(1);
+                if (flags & 1) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+                if (flags & 2) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+                if (flags & 4) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_PRIORITY);
+                const uint8_t priority = (flags & 4) ? 1 : 0;
+
+                ImageBuffer buf(48, 40);
+                buf.InsertTile(16, 8, palette_index, tile, tileset, use_alpha);
+                std::vector<uint8_t> rgba(48 * 40 * 4);
+                buf.ConvertToRGBA(rgba, pals, ImageBuffer::PixelFormat::RGBA, low_pri, high_pri);
+
+                // Per-pixel reference: GetTile applies the flips, not the remap
+                const auto pixels = tileset.GetTile(tile);
+                for (size_t y = 0; y < 40; ++y) {
+                    for (size_t x = 0; x < 48; ++x) {
+                        uint8_t value = 0, pri = 0;
+                        if (x >= 16 && x < 16 + tile_size && y >= 8 && y < 8 + tile_size) {
+                            const uint8_t index = pixels[(y - 8) * tile_size + (x - 16)];
+                            const uint8_t colour = use_remap ? remap[index] : index;
+                            if (!use_alpha || colour != 0) {
+                                value = static_cast<uint8_t>(colour | (palette_index << 4));
+                                pri = priority;
+                            }
+                        }
+                        const auto& pal = *pals[value / 16];
+                        const uint8_t* p = &rgba[(y * 48 + x) * 4];
+                        SCOPED_TRACE(testing::Message() << "remap " << use_remap << " alpha " << use_alpha
+                                     << " flags " << flags << " at " << x << ", " << y);
+                        ASSERT_EQ(p[0], pal.getR(value % 16));
+                        ASSERT_EQ(p[1], pal.getG(value % 16));
+                        ASSERT_EQ(p[2], pal.getB(value % 16));
+                        ASSERT_EQ(p[3], std::min(pri ? high_pri : low_pri, pal.getA(value % 16)));
+                    }
+                }
+            }
+        }
+    }
+
+    // A wide tile that would run past the right edge is not drawn
+    ImageBuffer edge(24, 24);
+    edge.InsertTile(16, 0, palette_index, Tile(1), tileset, false);
+    std::vector<uint8_t> before(24 * 24 * 4), after(24 * 24 * 4);
+    ImageBuffer(24, 24).ConvertToRGBA(before, pals);
+    edge.ConvertToRGBA(after, pals);
+    EXPECT_EQ(before, after);
+}
+
+TEST_F(ImageBufferTest, ConvertToRGBAMatchesSeparateChannels) {
+    auto tileset = MakeTileset(50);
+    ImageBuffer buf(40, 24);
+    for (int y = 0; y < 3; ++y) {
+        for (int x = 0; x < 5; ++x) {
+            buf.InsertTile(x * 8, y * 8, static_cast<uint8_t>(Next() % 4), RandomTile(50), *tileset);
+        }
+    }
+    const auto pals = MakePalettes();
+    const auto& rgb = buf.GetRGB(pals);
+    const auto& alpha = buf.GetAlpha(pals, 0x40, 0xC0);
+    
+    // Padded rows, to check the stride and that the padding is left alone
+    const size_t stride = 40 * 4 + 12;
+    std::vector<uint8_t> rgba(stride * 24, 0xAA);
+    std::vector<uint8_t> bgra(40 * 24 * 4);
+    buf.ConvertToRGBA(rgba, pals, ImageBuffer::PixelFormat::RGBA, 0x40, 0xC0, stride);
+    buf.ConvertToRGBA(bgra, pals, ImageBuffer::PixelFormat::BGRA, 0x40, 0xC0);
+    for (size_t y = 0; y < 24; ++y) {
+        for (size_t x = 0; x < 40; ++x) {
+            const size_t i = y * 40 + x;
+            const uint8_t* p = &rgba[y * stride + x * 4];
+            const uint8_t* q = &bgra[i * 4];
+            EXPECT_EQ(p[0], rgb[i * 3]);
+            EXPECT_EQ(p[1], rgb[i * 3 + 1]);
+            EXPECT_EQ(p[2], rgb[i * 3 + 2]);
+            EXPECT_EQ(p[3], alpha[i]);
+            EXPECT_EQ(q[0], p[2]);
+            EXPECT_EQ(q[1], p[1]);
+            EXPECT_EQ(q[2], p[0]);
+            EXPECT_EQ(q[3], p[3]);
+        }
+        for (size_t x = 40 * 4; x < stride; ++x) {
+            EXPECT_EQ(rgba[y * stride + x], 0xAA);
+        }
+    }
+    
+    std::vector<uint8_t> small(40 * 24 * 4 - 1);
+    EXPECT_THROW(buf.ConvertToRGBA(small, pals), std::runtime_error);
+    EXPECT_THROW(buf.ConvertToRGBA(bgra, pals, ImageBuffer::PixelFormat::RGBA, 0xFF, 0xFF, 40), std::runtime_error);
+}
+
+TEST_F(ImageBufferTest, EncodePNGWritesIndexedImage) {
+    auto tileset = MakeTileset(50);
+    ImageBuffer buf(64, 40);
+    for (int y = 0; y < 5; ++y) {
+        for (int x = 0; x < 8; ++x) {
+            buf.InsertTile(x * 8, y * 8, 0, RandomTile(50), *tileset);
+        }
+    }
+    auto pals = MakePalettes();
+    pals.resize(1);
+    
+    // Finds a chunk and returns its length and the offset of its data
+    auto find_chunk = [](const std::vector<uint8_t>& png, const std::string& type) {
+        size_t pos = 8;
+        while (pos + 8 <= png.size()) {
+            const size_t length = (png[pos] << 24) | (png[pos + 1] << 16) | (png[pos + 2] << 8) | png[pos + 3];
+            if (std::string(png.begin() + pos + 4, png.begin() + pos + 8) == type) {
+                return std::make_pair(length, pos + 8);
+            }
+            pos += length + 12;
+        }
+        return std::make_pair(size_t(0), size_t(0));
+    };
+    
+    const auto trimmed = buf.EncodePNG(pals);
+    ASSERT_GT(trimmed.size(), 8u);
+    EXPECT_EQ(std::vector<uint8_t>(trimmed.begin(), trimmed.begin() + 8),
+              (std::vector<uint8_t>{0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'}));
+    const auto ihdr = find_chunk(trimmed, "IHDR");
+    EXPECT_EQ(trimmed[ihdr.second + 8], 4);  // Bit depth
+    EXPECT_EQ(trimmed[ihdr.second + 9], 3);  // Indexed colour
+    EXPECT_EQ(find_chunk(trimmed, "PLTE").first, 16u * 3);
+    
+    PngOptions full;
+    full.trim_palette = false;
+    const auto untrimmed = buf.EncodePNG(pals, full);
+    EXPECT_EQ(untrimmed[find_chunk(untrimmed, "IHDR").second + 8], 8);
+    EXPECT_EQ(find_chunk(untrimmed, "PLTE").first, 256u * 3);
+    EXPECT_EQ(find_chunk(untrimmed, "tRNS").first, 256u);
+    
+    // The streamed output matches the buffered output
+    PngOptions options;
+    options.compression_level = 1;
+    options.filter = PngOptions::Filter::ADAPTIVE;
+    std::vector<uint8_t> streamed;
+    buf.EncodePNG([&](std::span<const uint8_t> bytes) {
+        streamed.insert(streamed.end(), bytes.begin(), bytes.end());
+    }, pals, options);
+    EXPECT_EQ(streamed, buf.EncodePNG(pals, options));
+    
+    // Errors from the writer reach the caller
+    EXPECT_THROW(buf.EncodePNG([](std::span<const uint8_t>) {
+        throw std::runtime_error("disk full");
+    }, pals), std::runtime_error);
+}
@@ -1,8 +1,13 @@
 #include <gtest/gtest.h>
 #include <landstalker/misc/LZ77.h>
+#include <landstalker/main/DataTypes.h>
+#include <landstalker/main/GameData.h>
 #include <vector>
+#include <algorithm>
 #include <cstdint>
 #include <iostream>
+#include <chrono>
+#include <stdexcept>
 
 using namespace Landstalker;
 
@@ -112,3 +117,283 @@ TEST(LZ77Test, ComplexCompressibleData) {
     TestCompressionCycle(uncompressed);
 }
 
+
+TEST(LZ77Test, LongRangeMatchesBeyondWindow) {
+    std::vector<uint8_t> uncompressed;
+    // Blocks of noise repeated at distances both inside and outside of the
+    // 4095-byte window, so the match finder has to respect the window limit.
+    srand(54321);
+    std::vector<uint8_t> block(3000);
+    for (auto& b : block) b = rand() % 256;
+    for (int i = 0; i < 6; ++i) {
+        uncompressed.insert(uncompressed.end(), block.begin(), block.end());
+        for (int j = 0; j < 1500 * (i % 3); ++j) uncompressed.push_back(rand() % 4);
+    }
+    std::cout << "Testing repeats across the window boundary..." << std::endl;
+    TestCompressionCycle(uncompressed);
+}
+
+TEST(LZ77Test, BoundedDecodeRoundTrip) {
+    std::vector<uint8_t> uncompressed;
+    for (int i = 0; i < 4000; ++i) {
+        uncompressed.push_back(static_cast<uint8_t>((i % 7 == 0) ? i : (i / 13) % 5));
+    }
+    std::vector<uint8_t> compressed(uncompressed.size() * 2 + 1024);
+    compressed.resize(LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data()));
+
+    std::vector<uint8_t> decompressed(uncompressed.size());
+    std::size_t bytes_read = 0;
+    std::size_t decompressed_size = LZ77::Decode(compressed, decompressed, bytes_read);
+
+    EXPECT_EQ(decompressed_size, uncompressed.size());
+    EXPECT_EQ(bytes_read, compressed.size());
+    EXPECT_EQ(uncompressed, decompressed);
+}
+
+TEST(LZ77Test, BoundedDecodeReportsOverflow) {
+    std::vector<uint8_t> uncompressed(1000, 0x55);
+    std::vector<uint8_t> compressed(2048);
+    compressed.resize(LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data()));
+
+    std::vector<uint8_t> decompressed(uncompressed.size() - 1, 0xEE);
+    std::size_t bytes_read = 0;
+    EXPECT_THROW(LZ77::Decode(compressed, decompressed, bytes_read), std::runtime_error);
+}
+
+TEST(LZ77Test, BoundedDecodeReportsTruncation) {
+    std::vector<uint8_t> uncompressed;
+    for (int i = 0; i < 500; ++i) {
+        uncompressed.push_back(static_cast<uint8_t>(i * 31));
+    }
+    std::vector<uint8_t> compressed(2048);
+    compressed.resize(LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data()));
+    compressed.resize(compressed.size() - 2); // Strip the end marker
+
+    std::vector<uint8_t> decompressed(uncompressed.size());
+    std::size_t bytes_read = 0;
+    EXPECT_THROW(LZ77::Decode(compressed, decompressed, bytes_read), std::runtime_error);
+}
+
+TEST(LZ77Test, BoundedDecodeRejectsReferenceBeforeStart) {
+    // Command byte: one literal followed by a back-reference with offset 2
+    std::vector<uint8_t> compressed = { 0x80, 0xAA, 0x0F, 0x02, 0x00, 0x00 };
+    std::vector<uint8_t> decompressed(64);
+    std::size_t bytes_read = 0;
+    EXPECT_THROW(LZ77::Decode(compressed, decompressed, bytes_read), std::runtime_error);
+}
+
+// 32-byte 4bpp tiles: blank, flat-shaded, noisy, or a copy of a recent tile
+std::vector<uint8_t> MakeTileData(std::size_t size, unsigned int seed) {
+    std::vector<uint8_t> data;
+    srand(seed);
+    while (data.size() < size) {
+        int type = (data.size() < 1024) ? 2 : rand() % 4;
+        std::size_t copy_from = data.size() - 32 * (1 + rand() % 16);
+        for (int j = 0; j < 32; ++j) {
+            if (type == 0) data.push_back(0);
+            else if (type == 1) data.push_back(static_cast<uint8_t>(0x11 * (1 + (j / 8) % 3)));
+            else if (type == 2) data.push_back(rand() % 256);
+            else data.push_back(data[copy_from + j]);
+        }
+    }
+    return data;
+}
+
+// 32-byte 4bpp tiles of one or two flat colours split by an edge that
+// wanders from row to row, so rows only partly match earlier ones, mixed with
+// short motifs repeated at overlapping distances. Unlike MakeTileData, the
+// best match often starts a byte later, which is what separates the levels.
+std::vector<uint8_t> MakeShadedTileData(std::size_t size, unsigned int seed) {
+    std::vector<uint8_t> data;
+    srand(seed);
+    while (data.size() < size) {
+        const uint8_t a = rand() % 16;
+        const uint8_t b = rand() % 16;
+        if (rand() % 3 != 0) {
+            int edge = rand() % 9;
+            for (int row = 0; row < 8; ++row) {
+                if (rand() % 3 == 0) {
+                    edge = std::clamp(edge + rand() % 3 - 1, 0, 8);
+                }
+                for (int x = 0; x < 8; x += 2) {
+                    data.push_back(static_cast<uint8_t>(((x < edge ? a : b) << 4) | (x + 1 < edge ? a : b)));
+                }
+            }
+        } else {
+            std::vector<uint8_t> motif(2 + rand() % 4);
+            for (auto& m : motif) m = rand() % 256;
+            for (int rep = 2 + rand() % 5; rep > 0; --rep) {
+                data.insert(data.end(), motif.begin(), motif.end() - rand() % 2);
+            }
+            if (data.size() > 40 && rand() % 2) {
+                std::size_t from = data.size() - 1 - rand() % 40;
+                for (int n = 3 + rand() % 6; n > 0; --n) data.push_back(data[from++]);
+                data.push_back(rand() % 256);
+            }
+        }
+    }
+    data.resize(size);
+    return data;
+}
+
+std::vector<std::size_t> EncodeAtEachLevel(const std::vector<uint8_t>& uncompressed) {
+    std::vector<std::size_t> sizes;
+    for (auto level : {LZ77::Level::FAST, LZ77::Level::LAZY, LZ77::Level::OPTIMAL}) {
+        std::vector<uint8_t> compressed(uncompressed.size() * 2 + 1024);
+        std::size_t compressed_size = LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data(), level);
+        compressed.resize(compressed_size);
+        sizes.push_back(compressed_size);
+
+        std::vector<uint8_t> decompressed(uncompressed.size());
+        std::size_t bytes_read = 0;
+        EXPECT_EQ(LZ77::Decode(compressed, decompressed, bytes_read), uncompressed.size());
+        EXPECT_EQ(bytes_read, compressed_size);
+        EXPECT_EQ(uncompressed, decompressed);
+    }
+    return sizes;
+}
+
+// Every level round-trips. On shaded tiles each level is smaller than the
+// faster level below it; OPTIMAL is never beaten.
+TEST(LZ77Test, CompressionLevelsOrderedBySize) {
+    const auto shaded = EncodeAtEachLevel(MakeShadedTileData(32768, 1));
+    EXPECT_LT(shaded[2], shaded[1]);
+    EXPECT_LT(shaded[1], shaded[0]);
+
+    // Noise and whole-tile copies give every level the same matches, and here
+    // deferring one costs LAZY a couple of bytes over FAST
+    const auto copies = EncodeAtEachLevel(MakeTileData(32768, 2468));
+    EXPECT_LE(copies[2], copies[1]);
+    EXPECT_LE(copies[2], copies[0]);
+}
+
+// Reports encode time and size for each level on shaded tiles. Timing is
+// machine-dependent, so this is not part of the gating suite; run it with
+// --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*
+TEST(LZ77Test, DISABLED_CompressionLevelBenchmark) {
+    constexpr int RUNS = 10;
+
+    for (unsigned int seed = 1; seed <= 4; ++seed) {
+        const std::vector<uint8_t> uncompressed = MakeShadedTileData(32768, seed);
+        double fast_ms = 0.0;
+        std::size_t fast_size = 0;
+        for (auto level : {LZ77::Level::FAST, LZ77::Level::LAZY, LZ77::Level::OPTIMAL}) {
+            std::vector<uint8_t> compressed(uncompressed.size() * 2 + 1024);
+            std::size_t compressed_size = 0;
+            auto start = std::chrono::steady_clock::now();
+            for (int i = 0; i < RUNS; ++i) {
+                compressed_size = LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data(), level);
+            }
+            auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / RUNS;
+            if (level == LZ77::Level::FAST) {
+                fast_ms = elapsed;
+                fast_size = compressed_size;
+            }
+            const char* name = level == LZ77::Level::FAST ? "FAST" : level == LZ77::Level::LAZY ? "LAZY" : "OPTIMAL";
+            std::cout << "seed " << seed << " " << name << ": " << compressed_size << " bytes ("
+                      << 100.0 * compressed_size / fast_size << "% of FAST), "
+                      << elapsed << " ms per encode (" << elapsed / fast_ms << "x FAST)" << std::endl;
+        }
+    }
+}
+
+TEST(LZ77Test, EntriesSerialiseAtOwnerLevel) {
+    Tileset tiles;
+    tiles.SetBits(MakeTileData(8192, 1357));
+    DataManager owner;
+    auto entry = TilesetEntry::Create(&owner, tiles.GetBits(true), "tiles", "tiles.lz77");
+    // Only modified entries are reserialised
+    entry->GetData()->GetTilePixels(0)[0] ^= 1;
+    const auto expected = entry->GetData()->GetBits(false);
+
+    std::vector<std::size_t> sizes;
+    for (auto level : {LZ77::Level::FAST, LZ77::Level::OPTIMAL}) {
+        owner.SetCompressionLevel(level);
+        const std::size_t length = entry->GetDataLength();
+        const auto bytes = entry->GetBytes();
+        EXPECT_EQ(bytes->size(), length);
+        sizes.push_back(length);
+
+        std::vector<uint8_t> decompressed(expected.size());
+        std::size_t bytes_read = 0;
+        EXPECT_EQ(LZ77::Decode(*bytes, decompressed, bytes_read), expected.size());
+        EXPECT_EQ(decompressed, expected);
+    }
+    EXPECT_LT(sizes[1], sizes[0]);
+}
+
+TEST(LZ77Test, GameDataLevelReachesItsEntries) {
+    Tileset tiles;
+    tiles.SetBits(MakeTileData(8192, 2468));
+    GameData game;
+    // Set through the base class, as an editor holding a DataManager would
+    DataManager& owner = game;
+    owner.SetCompressionLevel(LZ77::Level::FAST);
+    EXPECT_EQ(game.GetCompressionLevel(), LZ77::Level::FAST);
+
+    auto entry = TilesetEntry::Create(&game, tiles.GetBits(true), "tiles", "tiles.lz77");
+    entry->GetData()->GetTilePixels(0)[0] ^= 1;
+    EXPECT_EQ(*entry->GetBytes(), entry->GetData()->GetBits(true, LZ77::Level::FAST));
+    EXPECT_NE(*entry->GetBytes(), entry->GetData()->GetBits(true, LZ77::Level::OPTIMAL));
+}
+
+TEST(LZ77Test, DecodedSizeMatchesDecode) {
+    std::vector<uint8_t> uncompressed;
+    srand(97531);
+    for (int i = 0; i < 5000; ++i) {
+        uncompressed.push_back((rand() % 3) ? static_cast<uint8_t>(i / 40) : static_cast<uint8_t>(rand()));
+    }
+    std::vector<uint8_t> compressed(uncompressed.size() * 2 + 1024);
+    compressed.resize(LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data()));
+    // Trailing data after the end marker must not be counted
+    compressed.insert(compressed.end(), { 0xFF, 0xFF, 0xFF });
+
+    std::size_t probed_elen = 0;
+    std::size_t probed_size = LZ77::DecodedSize(compressed, probed_elen);
+    EXPECT_EQ(probed_size, uncompressed.size());
+    EXPECT_EQ(probed_elen, compressed.size() - 3);
+
+    std::vector<uint8_t> decompressed(probed_size);
+    std::size_t bytes_read = 0;
+    EXPECT_EQ(LZ77::Decode(compressed, decompressed, bytes_read), probed_size);
+    EXPECT_EQ(bytes_read, probed_elen);
+    EXPECT_EQ(uncompressed, decompressed);
+
+    compressed.resize(probed_elen - 2);
+    EXPECT_THROW(LZ77::DecodedSize(compressed, probed_elen), std::runtime_error);
+}
+
+TEST(LZ77Test, DecodeAndUnpackMatchesDecode) {
+    std::vector<uint8_t> uncompressed;
+    srand(24680);
+    for (int i = 0; i < 5000; ++i) {
+        uncompressed.push_back((rand() % 4) ? static_cast<uint8_t>((i / 3) % 7 * 0x11) : static_cast<uint8_t>(rand()));
+    }
+    std::vector<uint8_t> compressed(uncompressed.size() * 2 + 1024);
+    compressed.resize(LZ77::Encode(uncompressed.data(), uncompressed.size(), compressed.data()));
+
+    for (std::size_t depth : {1, 2, 4, 8}) {
+        const std::size_t pixels_per_byte = 8 / depth;
+        std::vector<uint8_t> expected;
+        for (uint8_t byte : uncompressed) {
+            for (std::size_t p = pixels_per_byte; p > 0; --p) {
+                expected.push_back((byte >> ((p - 1) * depth)) & ((1 << depth) - 1));
+            }
+        }
+        std::vector<uint8_t> pixels(expected.size());
+        std::size_t bytes_read = 0;
+        EXPECT_EQ(LZ77::DecodeAndUnpack(compressed, pixels, depth, bytes_read), expected.size());
+        EXPECT_EQ(bytes_read, compressed.size());
+        EXPECT_EQ(pixels, expected) << depth << "bpp";
+
+        pixels.pop_back();
+        EXPECT_THROW(LZ77::DecodeAndUnpack(compressed, pixels, depth, bytes_read), std::runtime_error);
+
+        // The vector version grows its output from empty and trims it to fit
+        std::vector<uint8_t> grown;
+        bytes_read = 0;
+        EXPECT_EQ(LZ77::DecodeAndUnpackToVector(compressed, grown, depth, bytes_read), expected.size());
+        EXPECT_EQ(bytes_read, compressed.size());
+        EXPECT_EQ(grown, expected) << depth << "bpp";
+    }
+}
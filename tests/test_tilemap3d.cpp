@@ -1,8 +1,12 @@
 #include <gtest/gtest.h>
 #include <landstalker/3d_maps/Tilemap3DCmp.h>
+#include <landstalker/3d_maps/Tilemap3DOverlay.h>
+#include <landstalker/3d_maps/TileSwaps.h>
 #include <vector>
 #include <iostream>
 #include <iomanip>
+#include <span>
+#include <stdexcept>
 
 using namespace Landstalker;
 
@@ -18,6 +22,16 @@ protected:
     size_t GetUncompressedSize(const Tilemap3D& tm) const {
         return tm.GetSize() * 4 + tm.GetHeightmapSize() * 2 + 6;
     }
+
+    // FNV-1a, to compare encoder output against reference output recorded
+    // from the original encoder
+    uint32_t Hash(const uint8_t* data, size_t size) const {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < size; ++i) {
+            hash = (hash ^ data[i]) * 16777619u;
+        }
+        return hash;
+    }
 };
 
 TEST_F(Tilemap3DTest, AllZeros) {
@@ -30,6 +44,8 @@ TEST_F(Tilemap3DTest, AllZeros) {
     
     uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
     PrintCompressionRatio("AllZeros", uncompressed_size, compressed_size);
+    EXPECT_EQ(compressed_size, 29);
+    EXPECT_EQ(Hash(buffer.data(), compressed_size), 0x8F21EED0u);
     
     Tilemap3D tm2;
     tm2.Decode(buffer.data());
@@ -60,6 +76,8 @@ TEST_F(Tilemap3DTest, RepeatedStandardPattern) {
     
     uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
     PrintCompressionRatio("RepeatedStandardPattern", uncompressed_size, compressed_size);
+    EXPECT_EQ(compressed_size, 813);
+    EXPECT_EQ(Hash(buffer.data(), compressed_size), 0x4E2A2CDAu);
     
     Tilemap3D tm2;
     tm2.Decode(buffer.data());
@@ -83,9 +101,175 @@ TEST_F(Tilemap3DTest, IncrementingBlocks) {
     
     uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
     PrintCompressionRatio("IncrementingBlocks", uncompressed_size, compressed_size);
+    EXPECT_EQ(compressed_size, 726);
+    EXPECT_EQ(Hash(buffer.data(), compressed_size), 0x0A062020u);
     
     Tilemap3D tm2;
     tm2.Decode(buffer.data());
     
     EXPECT_EQ(tm, tm2);
 }
+
+TEST_F(Tilemap3DTest, LargeMapWithVerticalRuns) {
+    Tilemap3D tm;
+    tm.Resize(64, 64);
+    tm.ResizeHeightmap(32, 32);
+    
+    // Columns of repeating blocks give the encoder plenty of vertical and
+    // diagonal runs to merge, with the odd stray block to break them up.
+    for(int y = 0; y < 64; ++y) {
+        for(int x = 0; x < 64; ++x) {
+            uint16_t val = 0x100 + (x % 3) + (y % 5) * 3;
+            if ((x * 7 + y * 13) % 29 == 0) {
+                val = static_cast<uint16_t>(0x200 + x + y);
+            }
+            tm.SetBlock(val, x + y * 64, Tilemap3D::Layer::BG);
+            tm.SetBlock(val + ((x + y) % 2), x + y * 64, Tilemap3D::Layer::FG);
+        }
+    }
+    for(int y = 0; y < 32; ++y) {
+        for(int x = 0; x < 32; ++x) {
+            tm.SetHeightmapCell({x, y}, static_cast<uint16_t>(((x / 4) % 3) << 8));
+        }
+    }
+    
+    size_t uncompressed_size = GetUncompressedSize(tm);
+    std::vector<uint8_t> buffer(65536, 0);
+    
+    uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
+    PrintCompressionRatio("LargeMapWithVerticalRuns", uncompressed_size, compressed_size);
+    EXPECT_EQ(compressed_size, 2053);
+    EXPECT_EQ(Hash(buffer.data(), compressed_size), 0xC935321Bu);
+    
+    Tilemap3D tm2;
+    tm2.Decode(buffer.data());
+    
+    EXPECT_EQ(tm, tm2);
+}
+
+TEST_F(Tilemap3DTest, ExhaustiveCompressionSmallerThanNormal) {
+    Tilemap3D tm;
+    tm.Resize(20, 12);
+    tm.ResizeHeightmap(10, 6);
+    
+    // Staggered rows of a few repeating patterns, so the best back offsets
+    // aren't simply the most frequent ones
+    for(int y = 0; y < 12; ++y) {
+        for(int x = 0; x < 20; ++x) {
+            int shift = (y / 3) % 4;
+            uint16_t val = 0x40 + ((x + shift) % 7) + ((y % 3) * 7);
+            if ((x * 11 + y * 5) % 23 == 0) {
+                val = static_cast<uint16_t>(0x180 + x);
+            }
+            tm.SetBlock(val, x + y * 20, Tilemap3D::Layer::BG);
+            tm.SetBlock(static_cast<uint16_t>(val + 0x20 * (x % 2)), x + y * 20, Tilemap3D::Layer::FG);
+        }
+    }
+    
+    size_t uncompressed_size = GetUncompressedSize(tm);
+    std::vector<uint8_t> normal(65536, 0);
+    std::vector<uint8_t> exhaustive(65536, 0);
+    std::vector<uint8_t> single_thread(65536, 0);
+    
+    uint16_t normal_size = tm.Encode(normal.data(), normal.size());
+    uint16_t exhaustive_size = tm.Encode(exhaustive.data(), exhaustive.size(), Tilemap3D::Compression::EXHAUSTIVE, 2);
+    PrintCompressionRatio("Normal", uncompressed_size, normal_size);
+    PrintCompressionRatio("Exhaustive", uncompressed_size, exhaustive_size);
+    EXPECT_LT(exhaustive_size, normal_size);
+    
+    // The search result doesn't depend on how many threads ran it
+    uint16_t single_thread_size = tm.Encode(single_thread.data(), single_thread.size(), Tilemap3D::Compression::EXHAUSTIVE, 1);
+    EXPECT_EQ(single_thread_size, exhaustive_size);
+    EXPECT_EQ(single_thread, exhaustive);
+    
+    Tilemap3D tm2;
+    tm2.Decode(exhaustive.data());
+    
+    EXPECT_EQ(tm, tm2);
+}
+
+TEST_F(Tilemap3DTest, BoundedDecodeReportsBytesConsumed) {
+    Tilemap3D tm;
+    tm.Resize(24, 20);
+    tm.ResizeHeightmap(12, 10);
+    for(int i = 0; i < 24 * 20; ++i) {
+        tm.SetBlock(static_cast<uint16_t>(0x80 + (i % 9)), i, Tilemap3D::Layer::BG);
+        tm.SetBlock(static_cast<uint16_t>(0x100 + (i % 13)), i, Tilemap3D::Layer::FG);
+    }
+    
+    std::vector<uint8_t> buffer(65536, 0);
+    uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
+    buffer.resize(compressed_size);
+    
+    // Decoding again into the same map reuses the layer storage
+    Tilemap3D tm2;
+    EXPECT_EQ(tm2.Decode(buffer), compressed_size);
+    EXPECT_EQ(tm, tm2);
+    const auto* fg_data = tm2.GetLayer(Tilemap3D::Layer::FG).data();
+    const auto* bg_data = tm2.GetLayer(Tilemap3D::Layer::BG).data();
+    const auto fg_capacity = tm2.GetLayer(Tilemap3D::Layer::FG).capacity();
+    const auto bg_capacity = tm2.GetLayer(Tilemap3D::Layer::BG).capacity();
+    EXPECT_EQ(fg_capacity, tm2.GetSize());
+    EXPECT_EQ(tm2.Decode(buffer), compressed_size);
+    EXPECT_EQ(tm, tm2);
+    EXPECT_EQ(tm2.GetLayer(Tilemap3D::Layer::FG).data(), fg_data);
+    EXPECT_EQ(tm2.GetLayer(Tilemap3D::Layer::BG).data(), bg_data);
+    EXPECT_EQ(tm2.GetLayer(Tilemap3D::Layer::FG).capacity(), fg_capacity);
+    EXPECT_EQ(tm2.GetLayer(Tilemap3D::Layer::BG).capacity(), bg_capacity);
+    
+    Tilemap3D tm3(std::span<const uint8_t>(buffer.data(), buffer.size()));
+    EXPECT_EQ(tm, tm3);
+}
+
+TEST_F(Tilemap3DTest, BoundedDecodeRejectsTruncatedInput) {
+    Tilemap3D tm;
+    tm.Resize(16, 16);
+    tm.ResizeHeightmap(8, 8);
+    for(int i = 0; i < 256; ++i) {
+        tm.SetBlock(static_cast<uint16_t>((i * 37) % 200), i, Tilemap3D::Layer::BG);
+    }
+    
+    std::vector<uint8_t> buffer(65536, 0);
+    uint16_t compressed_size = tm.Encode(buffer.data(), buffer.size());
+    
+    for(size_t len : { size_t(0), size_t(4), size_t(compressed_size / 2), size_t(compressed_size - 1) }) {
+        Tilemap3D tm2;
+        EXPECT_THROW(tm2.Decode(std::span<const uint8_t>(buffer.data(), len)), std::runtime_error) << "length " << len;
+    }
+}
+
+TEST_F(Tilemap3DTest, OverlaySwapsMatchPatchedCopy) {
+    Tilemap3D tm;
+    tm.Resize(24, 24);
+    tm.ResizeHeightmap(12, 12);
+    for(int i = 0; i < 24 * 24; ++i) {
+        tm.SetBlock(static_cast<uint16_t>(i % 300), i, Tilemap3D::Layer::BG);
+        tm.SetBlock(static_cast<uint16_t>((i * 7) % 300), i, Tilemap3D::Layer::FG);
+    }
+    const Tilemap3D original = tm;
+    
+    // Overlapping source and destination regions, in every mode, so later
+    // swaps read blocks written by earlier ones
+    std::vector<TileSwap> swaps = {
+        TileSwap(0, {2, 3, 4, 4, 6, 5}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::FLOOR),
+        TileSwap(0, {5, 5, 3, 6, 4, 6}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::WALL_NE),
+        TileSwap(0, {1, 9, 6, 2, 3, 5}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::WALL_NW),
+        TileSwap(0, {30, 30, 10, 10, 4, 4}, {0, 0, 0, 0, 1, 1}, TileSwap::Mode::FLOOR)
+    };
+    
+    for(auto layer : { Tilemap3D::Layer::BG, Tilemap3D::Layer::FG }) {
+        Tilemap3D patched = tm;
+        Tilemap3DOverlay overlay(tm, layer);
+        for(const auto& swap : swaps) {
+            swap.DrawSwap(patched, layer);
+            swap.DrawSwap(overlay);
+        }
+        EXPECT_TRUE(overlay.IsModified());
+        for(int y = 0; y < 24; ++y) {
+            for(int x = 0; x < 24; ++x) {
+                EXPECT_EQ(overlay.GetBlock({x, y}), patched.GetBlock({x, y}, layer)) << x << ", " << y;
+            }
+        }
+    }
+    EXPECT_EQ(tm, original);
+}
@@ -0,0 +1,388 @@
+#include <gtest/gtest.h>
+#include <landstalker/tileset/Tileset.h>
+#include <landstalker/tileset/AnimatedTileset.h>
+#include <vector>
+#include <type_traits>
+#include <array>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <stdexcept>
+
+using namespace Landstalker;
+
+class TilesetTest : public ::testing::Test {
+protected:
+    static constexpr std::array<std::pair<Tileset::BlockType, std::pair<int, int>>, 7> BLOCK_TYPES = {{
+        {Tileset::BlockType::NORMAL,   {1, 1}},
+        {Tileset::BlockType::BLOCK1X2, {1, 2}},
+        {Tileset::BlockType::BLOCK2X1, {2, 1}},
+        {Tileset::BlockType::BLOCK2X2, {2, 2}},
+        {Tileset::BlockType::BLOCK3X3, {3, 3}},
+        {Tileset::BlockType::BLOCK4X4, {4, 4}},
+        {Tileset::BlockType::BLOCK4X6, {4, 6}}
+    }};
+
+    std::vector<uint8_t> MakeBytes(size_t count, uint32_t seed) const {
+        std::vector<uint8_t> bytes(count);
+        for (auto& b : bytes) {
+            seed = seed * 1103515245 + 12345;
+            b = static_cast<uint8_t>(seed >> 16);
+        }
+        return bytes;
+    }
+
+    // Index of the stored 8x8 tile shown at (x, y) within a block
+    int StoredTileAt(Tileset::BlockType type, int h, int x, int y) const {
+        if (type == Tileset::BlockType::BLOCK4X6) {
+            const int layout[6][4] = {
+                { 0,  4,  8, 12},
+                { 1,  5,  9, 13},
+                { 2,  6, 10, 14},
+                { 3,  7, 11, 15},
+                {16, 18, 20, 22},
+                {17, 19, 21, 23}
+            };
+            return layout[y][x];
+        }
+        return x * h + y;
+    }
+
+    // Straightforward per-pixel decode of the packed data into blocks
+    std::vector<uint8_t> ReferencePixels(const std::vector<uint8_t>& bytes, Tileset::BlockType type,
+                                         int w, int h, int depth, size_t block_count) const {
+        const size_t block_width = 8 * w;
+        const size_t block_area = 64 * w * h;
+        std::vector<uint8_t> pixels(block_area * block_count, 0);
+        for (size_t b = 0; b < block_count; ++b) {
+            for (size_t py = 0; py < 8 * static_cast<size_t>(h); ++py) {
+                for (size_t px = 0; px < block_width; ++px) {
+                    const int stored = StoredTileAt(type, h, px / 8, py / 8);
+                    const size_t bit = ((b * w * h + stored) * 64 + (py % 8) * 8 + (px % 8)) * depth;
+                    uint8_t value = 0;
+                    if (bit / 8 < bytes.size()) {
+                        value = (bytes[bit / 8] >> (8 - depth - bit % 8)) & ((1 << depth) - 1);
+                    }
+                    pixels[b * block_area + py * block_width + px] = value;
+                }
+            }
+        }
+        return pixels;
+    }
+};
+
+TEST_F(TilesetTest, SetBitsMatchesReferenceForAllBlockTypes) {
+    for (const auto& [type, dims] : BLOCK_TYPES) {
+        for (int depth : {1, 2, 4, 8}) {
+            const size_t block_bytes = 8 * dims.first * dims.second * depth;
+            // Leave the final block short to exercise padding and partial runs
+            const auto bytes = MakeBytes(block_bytes * 7 - 3, depth * 31 + dims.first * 7 + dims.second);
+            Tileset ts(8, 8, depth, type);
+            ts.SetBits(bytes);
+            ASSERT_EQ(ts.GetTileCount(), 7u);
+            const auto expected = ReferencePixels(bytes, type, dims.first, dims.second, depth, 7);
+            const auto actual = ts.GetPixels();
+            EXPECT_TRUE(std::equal(actual.begin(), actual.end(), expected.begin(), expected.end()))
+                << "block type " << static_cast<int>(type) << ", " << depth << "bpp";
+        }
+    }
+}
+
+TEST_F(TilesetTest, GetBitsRoundTripsForAllBlockTypes) {
+    for (const auto& [type, dims] : BLOCK_TYPES) {
+        for (int depth : {1, 2, 4, 8}) {
+            const size_t block_bytes = 8 * dims.first * dims.second * depth;
+            const auto bytes = MakeBytes(block_bytes * 5, depth * 17 + dims.first * 3 + dims.second);
+            Tileset ts(8, 8, depth, type);
+            ts.SetBits(bytes);
+            EXPECT_EQ(ts.GetBits(), bytes) << "block type " << static_cast<int>(type) << ", " << depth << "bpp";
+        }
+    }
+}
+
+TEST_F(TilesetTest, CompressedRoundTrip) {
+    const auto bytes = MakeBytes(32 * 300, 1);
+    Tileset ts(bytes);
+    const auto compressed = ts.GetBits(true);
+
+    Tileset ts2(compressed, true);
+    EXPECT_EQ(ts, ts2);
+    EXPECT_EQ(ts2.GetBits(), bytes);
+}
+
+TEST_F(TilesetTest, TileViewAppliesFlips) {
+    const auto bytes = MakeBytes(32 * 2, 5);
+    Tileset ts(bytes);
+    const auto pixels = ts.GetTilePixels(1);
+    for (uint16_t flags = 0; flags < 4; ++flags) {
+        Tile tile(1);
+        if (flags & 1) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+        if (flags & 2) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+        const auto view = ts.GetTileView(tile);
+        const auto copy = ts.GetTile(tile);
+        for (size_t y = 0; y < 8; ++y) {
+            for (size_t x = 0; x < 8; ++x) {
+                const size_t sx = (flags & 1) ? 7 - x : x;
+                const size_t sy = (flags & 2) ? 7 - y : y;
+                EXPECT_EQ(view(x, y), pixels[sy * 8 + sx]);
+                EXPECT_EQ(copy[y * 8 + x], pixels[sy * 8 + sx]);
+            }
+        }
+    }
+}
+
+TEST_F(TilesetTest, FindTileDetectsFlippedDuplicates) {
+    auto bytes = MakeBytes(32 * 20, 9);
+    Tileset ts(bytes);
+    for (uint16_t index : {0, 7, 19}) {
+        for (uint16_t flags = 0; flags < 4; ++flags) {
+            Tile tile(index);
+            if (flags & 1) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+            if (flags & 2) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+            const auto pixels = ts.GetTile(tile);
+
+            const auto found = ts.FindTile(pixels);
+            ASSERT_TRUE(found.has_value());
+            EXPECT_EQ(found->GetIndex(), index);
+            EXPECT_EQ(ts.GetTile(*found), pixels);
+        }
+    }
+    std::vector<uint8_t> missing(64, 0);
+    missing[3] = 15;
+    EXPECT_FALSE(ts.FindTile(missing).has_value());
+}
+
+TEST_F(TilesetTest, FindTileFollowsEdits) {
+    Tileset ts(MakeBytes(32 * 4, 11));
+    std::vector<uint8_t> pixels(64);
+    for (size_t i = 0; i < pixels.size(); ++i) {
+        pixels[i] = static_cast<uint8_t>((i * 5) % 16);
+    }
+    EXPECT_FALSE(ts.FindTile(pixels).has_value());
+
+    ts.SetTile(Tile(2), pixels);
+    ASSERT_TRUE(ts.FindTile(pixels).has_value());
+    EXPECT_EQ(ts.FindTile(pixels)->GetIndex(), 2);
+
+    ts.DeleteTile(0);
+    ASSERT_TRUE(ts.FindTile(pixels).has_value());
+    EXPECT_EQ(ts.FindTile(pixels)->GetIndex(), 1);
+
+    ts.GetTilePixels(1)[0] ^= 1;
+    EXPECT_FALSE(ts.FindTile(pixels).has_value());
+}
+
+TEST_F(TilesetTest, TilePixelsKeepsVectorStyleAccess) {
+    Tileset ts(MakeBytes(32 * 3, 19));
+    const std::vector<uint8_t> original = ts.GetTile(Tile(1));
+
+    std::vector<uint8_t> copy = ts.GetTilePixels(1);
+    EXPECT_EQ(copy, original);
+    EXPECT_EQ(ts.GetTilePixels(1).at(5), original[5]);
+    EXPECT_THROW(ts.GetTilePixels(1).at(64), std::out_of_range);
+
+    // Assignment copies pixels into the tile rather than rebinding the view
+    ts.GetTilePixels(1) = std::vector<uint8_t>(64, 3);
+    EXPECT_EQ(ts.GetTile(Tile(1)), std::vector<uint8_t>(64, 3));
+    ts.GetTilePixels(1).Assign(ts.GetTilePixels(0));
+    EXPECT_EQ(ts.GetTile(Tile(1)), ts.GetTile(Tile(0)));
+    ts.GetTilePixels(2).at(0) = 4;
+    EXPECT_EQ(ts.GetTile(Tile(2))[0], 4);
+    EXPECT_THROW(ts.GetTilePixels(1) = std::vector<uint8_t>(32, 0), std::runtime_error);
+}
+
+TEST_F(TilesetTest, HeldTileViewsRebindWithoutTouchingPixels) {
+    // Copying pixels between views has to be asked for with Assign()
+    static_assert(!std::is_copy_assignable_v<TilePixels>);
+    static_assert(!std::is_swappable_v<TilePixels>);
+
+    Tileset ts(MakeBytes(32 * 2, 23));
+    ts.GetTilePixels(0).Assign(std::vector<uint8_t>(64, 1));
+    ts.GetTilePixels(1).Assign(std::vector<uint8_t>(64, 2));
+
+    auto a = ts.GetTileSpan(0);
+    auto b = ts.GetTileSpan(1);
+    std::swap(a, b);
+    EXPECT_EQ(a[0], 2);
+    EXPECT_EQ(b[0], 1);
+    EXPECT_EQ(ts.GetTile(Tile(0)), std::vector<uint8_t>(64, 1));
+    EXPECT_EQ(ts.GetTile(Tile(1)), std::vector<uint8_t>(64, 2));
+
+    a = b;
+    EXPECT_EQ(a.data(), b.data());
+    EXPECT_EQ(ts.GetTile(Tile(0)), std::vector<uint8_t>(64, 1));
+    EXPECT_EQ(ts.GetTile(Tile(1)), std::vector<uint8_t>(64, 2));
+
+    // A copied TilePixels is another view of the same tile
+    auto held = ts.GetTilePixels(0);
+    auto again = held;
+    again[0] = 5;
+    EXPECT_EQ(held[0], 5);
+    EXPECT_EQ(ts.GetTile(Tile(0))[0], 5);
+    EXPECT_EQ(ts.GetTile(Tile(1))[0], 2);
+
+    // Swapping tile contents goes through the ranges
+    std::swap_ranges(held.begin(), held.end(), ts.GetTileSpan(1).begin());
+    EXPECT_EQ(ts.GetTile(Tile(0))[0], 2);
+    EXPECT_EQ(ts.GetTile(Tile(1))[0], 5);
+}
+
+TEST_F(TilesetTest, ImportTilesReusesExistingTiles) {
+    Tileset ts(MakeBytes(32 * 3, 13));
+    Tile hflipped(1);
+    hflipped.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+
+    std::vector<uint8_t> fresh(64);
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        fresh[i] = static_cast<uint8_t>((i * 7 + 3) % 16);
+    }
+    std::vector<uint8_t> import;
+    for (const auto& tile : {ts.GetTile(hflipped), fresh, ts.GetTile(Tile(0)), fresh}) {
+        import.insert(import.end(), tile.begin(), tile.end());
+    }
+
+    const auto tiles = ts.ImportTiles(import);
+    ASSERT_EQ(tiles.size(), 4u);
+    EXPECT_EQ(ts.GetTileCount(), 4u);
+    EXPECT_EQ(tiles[0], hflipped);
+    EXPECT_EQ(tiles[1], Tile(3));
+    EXPECT_EQ(tiles[2], Tile(0));
+    EXPECT_EQ(tiles[3], Tile(3));
+    for (size_t i = 0; i < tiles.size(); ++i) {
+        EXPECT_TRUE(std::equal(import.begin() + i * 64, import.begin() + (i + 1) * 64, ts.GetTile(tiles[i]).begin()));
+    }
+}
+
+TEST_F(TilesetTest, RenderedTilesFollowFlipsRemapAndEdits) {
+    Tileset ts(MakeBytes(32 * 3, 17));
+    const std::vector<uint8_t> remap = {3, 0, 5, 7, 1, 2, 4, 6, 8, 9, 10, 11, 12, 13, 14, 15};
+    auto check = [&](const std::vector<uint8_t>& cmap) {
+        for (uint16_t index = 0; index < 3; ++index) {
+            for (uint16_t flags = 0; flags < 4; ++flags) {
+                Tile tile(index);
+                if (flags & 1) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_HFLIP);
+                if (flags & 2) tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+                const auto rows = ts.GetRenderedTile(tile);
+                ASSERT_EQ(rows.size(), 8u);
+                const auto expected = ts.GetTile(tile);
+                const auto* drawn = reinterpret_cast<const uint8_t*>(rows.data());
+                for (size_t i = 0; i < expected.size(); ++i) {
+                    EXPECT_EQ(drawn[i], cmap.empty() ? expected[i] : cmap[expected[i]]);
+                }
+            }
+        }
+    };
+    check({});
+    ts.SetColourIndicies(remap);
+    check(remap);
+    ts.SetTile(Tile(1), std::vector<uint8_t>(64, 2));
+    EXPECT_EQ(ts.GetRenderedTile(Tile(1))[0], 0x0505050505050505ULL);
+    check(remap);
+    // Writing through a fresh span is picked up without anything else
+    ts.GetTilePixels(2)[1] = 11;
+    check(remap);
+    // A span kept past a draw needs marking
+    auto pixels = ts.GetTilePixels(2);
+    check(remap);
+    pixels[0] = 9;
+    ts.MarkTilesDirty();
+    check(remap);
+
+    // Importing appends tiles the cache hasn't seen yet
+    ASSERT_FALSE(ts.GetRenderedTile(Tile(0)).empty());
+    const auto imported = ts.ImportTiles(std::vector<uint8_t>(64, 7));
+    ASSERT_EQ(imported.size(), 1u);
+    EXPECT_EQ(imported[0].GetIndex(), 3);
+    const auto rows = ts.GetRenderedTile(imported[0]);
+    ASSERT_EQ(rows.size(), 8u);
+    EXPECT_EQ(rows[0], 0x0606060606060606ULL);
+
+    Tileset wide(MakeBytes(32 * 4, 3), false, 16, 8, 4, Tileset::BlockType::BLOCK2X1);
+    EXPECT_TRUE(wide.GetRenderedTile(Tile(0)).empty());
+}
+
+TEST_F(TilesetTest, RenderedTilesBuildOnceAcrossThreads) {
+    const Tileset reference(MakeBytes(32 * 64, 29));
+    std::vector<uint64_t> expected;
+    for (uint16_t i = 0; i < 64; ++i) {
+        const auto rows = reference.GetRenderedTile(Tile(i));
+        expected.insert(expected.end(), rows.begin(), rows.end());
+    }
+
+    // Several threads race to build the cache of a shared, freshly loaded tileset
+    for (int round = 0; round < 4; ++round) {
+        auto ts = std::make_shared<const Tileset>(MakeBytes(32 * 64, 29));
+        std::vector<std::vector<uint64_t>> drawn(4);
+        std::vector<std::thread> threads;
+        for (auto& out : drawn) {
+            threads.emplace_back([&ts, &out]() {
+                for (uint16_t i = 0; i < 64; ++i) {
+                    const auto rows = ts->GetRenderedTile(Tile(i));
+                    out.insert(out.end(), rows.begin(), rows.end());
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (const auto& out : drawn) {
+            EXPECT_EQ(out, expected);
+        }
+    }
+}
+
+TEST_F(TilesetTest, FindTileBuildsIndexOnceAcrossThreads) {
+    // Several threads race to build the search index of a shared tileset
+    const auto bytes = MakeBytes(32 * 64, 31);
+    for (int round = 0; round < 4; ++round) {
+        auto ts = std::make_shared<const Tileset>(bytes);
+        std::vector<std::vector<uint16_t>> found(4);
+        std::vector<std::thread> threads;
+        for (auto& out : found) {
+            threads.emplace_back([&ts, &out]() {
+                for (int i = 0; i < 64; ++i) {
+                    const auto tile = ts->FindTile(ts->GetTilePixels(i));
+                    out.push_back(tile ? tile->GetIndex() : 0xFFFF);
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        for (const auto& out : found) {
+            for (int i = 0; i < 64; ++i) {
+                // A random tile may show up earlier in some flip, but it is always found
+                EXPECT_LE(out[i], i);
+                EXPECT_EQ(out[i], found[0][i]);
+            }
+        }
+    }
+}
+
+TEST_F(TilesetTest, AnimatedTilesetFrameViews) {
+    // Three frames of two tiles, replacing room tiles 10 and 11. The second
+    // tile is the same in the first two frames.
+    auto bytes = MakeBytes(32 * 6, 21);
+    std::copy(bytes.begin() + 32, bytes.begin() + 64, bytes.begin() + 96);
+    AnimatedTileset ats(bytes, 10 * 32, 32, 4, 3);
+
+    EXPECT_TRUE(ats.ContainsTile(Tile(10)));
+    EXPECT_TRUE(ats.ContainsTile(Tile(11)));
+    EXPECT_FALSE(ats.ContainsTile(Tile(9)));
+    EXPECT_FALSE(ats.ContainsTile(Tile(12)));
+
+    Tile tile(11);
+    tile.Attributes().setAttribute(TileAttributes::Attribute::ATTR_VFLIP);
+    for (uint8_t frame = 0; frame < 3; ++frame) {
+        const auto pixels = ats.GetTilePixels(11, frame);
+        const auto expected = ats.Tileset::GetTilePixels(1 + frame * 2);
+        EXPECT_TRUE(std::equal(pixels.begin(), pixels.end(), expected.begin(), expected.end()));
+        const auto view = ats.GetTileView(tile, frame);
+        EXPECT_EQ(view(0, 0), expected[7 * 8]);
+    }
+
+    EXPECT_TRUE(ats.HasTileChanged(Tile(10), 1));
+    EXPECT_FALSE(ats.HasTileChanged(Tile(11), 1));
+    EXPECT_TRUE(ats.HasTileChanged(Tile(11), 2));
+    EXPECT_FALSE(ats.HasTileChanged(Tile(12), 1));
+}
@@ -0,0 +1,147 @@
+#include <gtest/gtest.h>
+#include <landstalker/misc/Utils.h>
+#include <landstalker/main/DataManager.h>
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <stdexcept>
+
+using namespace Landstalker;
+
+TEST(UtilsTest, ParallelForRunsEveryIndexOnce) {
+    for (std::size_t workers : { 0, 1, 2, 3, 8 }) {
+        std::vector<std::atomic<int>> runs(1000);
+        ParallelFor(runs.size(), [&](std::size_t i) { ++runs[i]; }, workers);
+        for (std::size_t i = 0; i < runs.size(); ++i) {
+            EXPECT_EQ(runs[i], 1) << "index " << i << " with " << workers << " workers";
+        }
+    }
+    // Nothing to do is not an error
+    ParallelFor(0, [](std::size_t) { FAIL(); });
+}
+
+TEST(UtilsTest, ParallelForRethrowsAfterAllWorkersStop) {
+    for (std::size_t workers : { 1, 2, 3, 8 }) {
+        std::vector<std::atomic<int>> runs(1000);
+        std::atomic<int> running = 0;
+        EXPECT_THROW(ParallelFor(runs.size(), [&](std::size_t i)
+        {
+            ++running;
+            ++runs[i];
+            if (i == 37) {
+                --running;
+                throw std::runtime_error("index 37");
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+            --running;
+        }, workers), std::runtime_error) << workers << " workers";
+        // Every worker has finished by the time the exception surfaces
+        EXPECT_EQ(running, 0);
+        EXPECT_EQ(runs[37], 1);
+        for (std::size_t i = 0; i < runs.size(); ++i) {
+            EXPECT_LE(runs[i], 1) << "index " << i << " with " << workers << " workers";
+        }
+        // Workers stop taking new indices once one has thrown
+        EXPECT_EQ(runs[runs.size() - 1], 0) << workers << " workers";
+    }
+}
+
+TEST(UtilsTest, ParallelForRethrowsFirstException) {
+    // With one worker the indices run in order, so the first to throw is known
+    try {
+        ParallelFor(100, [](std::size_t i)
+        {
+            if (i % 10 == 5) {
+                throw std::runtime_error("index " + std::to_string(i));
+            }
+        }, 1);
+        FAIL() << "Expected an exception";
+    }
+    catch (const std::runtime_error& e) {
+        EXPECT_STREQ(e.what(), "index 5");
+    }
+}
+
+TEST(UtilsTest, ParallelForSingleWorkerUsesCallingThread) {
+    // The calling thread always takes part, which is also what it falls back
+    // to when no other threads can be started
+    const auto caller = std::this_thread::get_id();
+    for (std::size_t workers : { 1, 8 }) {
+        std::size_t count = (workers == 1) ? 100 : 1;
+        std::atomic<int> elsewhere = 0;
+        ParallelFor(count, [&](std::size_t)
+        {
+            if (std::this_thread::get_id() != caller) {
+                ++elsewhere;
+            }
+        }, workers);
+        EXPECT_EQ(elsewhere, 0);
+    }
+}
+
+namespace {
+
+class TestManager : public DataManager
+{
+public:
+    struct Item
+    {
+        void Initialise()
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+    };
+
+    void Load(const std::vector<std::shared_ptr<Item>>& items) const
+    {
+        InitialiseEntries(items, "Loading");
+    }
+    void Advance(const std::string& status, double progress) const
+    {
+        AdvanceProgress(status, progress);
+    }
+};
+
+} // namespace
+
+TEST(UtilsTest, EntryProgressOnlyMovesForward) {
+    TestManager manager;
+    manager.SetWorkerCount(4);
+    std::vector<std::shared_ptr<TestManager::Item>> items;
+    for (int i = 0; i < 200; ++i) {
+        items.push_back(std::make_shared<TestManager::Item>());
+    }
+
+    std::atomic<bool> loading = true;
+    std::atomic<bool> went_backwards = false;
+    std::thread watcher([&]()
+    {
+        double last = 0.0;
+        while (loading) {
+            auto [status, progress] = manager.GetProgress();
+            if (status == "Loading") {
+                if (progress < last) {
+                    went_backwards = true;
+                }
+                last = progress;
+            }
+        }
+    });
+    manager.Load(items);
+    loading = false;
+    watcher.join();
+
+    EXPECT_FALSE(went_backwards);
+    EXPECT_EQ(manager.GetProgress().first, "Loading");
+    EXPECT_DOUBLE_EQ(manager.GetProgress().second, 1.0);
+
+    // A late, smaller report for the same status is ignored; a new status isn't
+    manager.Advance("Loading", 0.5);
+    EXPECT_DOUBLE_EQ(manager.GetProgress().second, 1.0);
+    manager.Advance("Saving", 0.25);
+    EXPECT_EQ(manager.GetProgress().first, "Saving");
+    EXPECT_DOUBLE_EQ(manager.GetProgress().second, 0.25);
+}